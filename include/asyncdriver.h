@@ -0,0 +1,94 @@
+#ifndef ASYNCDRIVER_H
+#define ASYNCDRIVER_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+#include "xvcdriver.h"
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#include <coroutine>
+#define ASYNCDRIVER_COROUTINE
+#endif
+
+/*
+   AsyncDriver queues shifts of a driver and runs them from a worker thread: operations
+   queued while the driver is busy are merged into a single shiftv() transaction, so
+   backends keep hardware busy (e.g. FTDI USB transfers in flight) across operations.
+   Completion is returned as a future or a callback running on the worker thread;
+   synchronous shift() waits the completion of its own operation
+*/
+
+// completion callback, ok is false if driver failed
+typedef std::function<void(bool ok)> shift_callback;
+
+typedef struct {
+   std::vector<shift_segment> segs;
+   std::function<void(std::exception_ptr)> done;
+} async_job;
+
+class AsyncDriver : public XVCDriver {
+
+public:
+   AsyncDriver(XVCDriver *d, bool v=false, int dl=0);
+   ~AsyncDriver();
+
+   // buffer holds TMS[] and TDI[] as in shift(), buffers must be valid until completion
+   std::future<void> submit(int nbits, unsigned char *buffer, unsigned char *result);
+   void submit(int nbits, unsigned char *buffer, unsigned char *result, shift_callback cb);
+   std::future<void> submitv(const std::vector<shift_segment> &segs);
+   void submitv(const std::vector<shift_segment> &segs, shift_callback cb);
+
+   void drain(void);
+   int getPending(void);
+
+   // must not be called from a completion callback
+   void shift(int nbits, unsigned char *buffer, unsigned char *result) { submit(nbits, buffer, result).get(); };
+   void shiftv(std::vector<shift_segment> &segs) { submitv(segs).get(); };
+
+#ifdef ASYNCDRIVER_COROUTINE
+   // co_await of a shift, the coroutine is resumed on the worker thread
+   class shift_awaiter {
+
+   public:
+      shift_awaiter(AsyncDriver *d, shift_segment s) : drv(d), seg(s) {};
+
+      bool await_ready(void) { return false; };
+      void await_suspend(std::coroutine_handle<> h) {
+         drv->submitv({seg}, [this, h](bool res) { ok = res; h.resume(); });
+      };
+      bool await_resume(void) { return ok; };
+
+   private:
+      AsyncDriver *drv;
+      shift_segment seg;
+      bool ok = false;
+   };
+
+   shift_awaiter shiftAsync(int nbits, unsigned char *buffer, unsigned char *result) {
+      return shift_awaiter(this, { nbits, buffer, buffer + (nbits + 7) / 8, result });
+   };
+#endif
+
+private:
+   XVCDriver *drv;
+
+   std::thread worker;
+   std::mutex lock;
+   std::condition_variable queueCond, idleCond;
+   std::deque<async_job> queue;
+   int pending = 0;
+   bool stop = false;
+
+   unsigned long jobs = 0, transactions = 0;
+
+   void enqueue(async_job job);
+   void run(void);
+};
+
+#endif
@@ -5,12 +5,33 @@
 
 #include "axidevice.h"
 #include "axisetup.h"
+#include "bertester.h"
+#include "probeengine.h"
+#include "tempsensor.h"
+#include "eyemap.h"
 
 /*
    AXICalibrator is a class to calibrate an AXI device using clock divisor
    and clock delay probing device for a valid idcode
 */
 
+#define CALIB_SWEEP     0     // every delay of every divisor
+#define CALIB_SEARCH    1     // binary search of the valid delay window edges
+#define CALIB_PREDICT   2     // windows predicted from the cable round-trip delay
+
+#define PROBE_WORDS     4     // random words streamed at each delay
+
+#define EYE_MAX_ERRORS  16    // errors ending the PRBS stream of an eye map cell
+#define EYE_TAIL        8     // failing cells recorded past the window of a row
+#define EYE_VECTOR_BITS 4096  // failing cells cost a single vector
+
+// valid delay window of a clock divisor
+typedef struct {
+   int minDelay;
+   int maxDelay;
+   int validPoints;
+} axi_eye;
+
 class AXICalibrator {
 
 public:
@@ -20,16 +41,53 @@ public:
    void setDebugLevel(int lvl) { debugLevel = lvl; }; 
    void setVerbose(bool v) { verbose = v; };
 
+   // PRBS bits checked through BYPASS on each candidate point, 0 disables the test
+   void setBERTest(int bits, int order=31) { berBits = bits; berOrder = order; };
+   // calibration run by a background task shares the driver with clients
+   void setGate(IdleGate *g) { gate = g; engine.setGate(g); };
+   // die temperature saved with calibration data
+   void setSensor(TempSensor *s) { sensor = s; };
+
    void setHysteresis(int v) { hyst = v; };
+   void setMode(int m) { mode = m; };
    void start(AXISetup *setup, unsigned int calibSize);
+   // fingerprint of the cable in delay units, -1 if no valid delay
+   int measureRoundTrip(void);
+   // slowest clock at the centre of its delay window, false if no valid delay
+   bool setSafeClock(void);
+   // window at cdiv from a delay known to be valid, edges are looked for around the
+   // ones of eye; the whole range is searched if cdel is not valid anymore
+   bool trackEye(int cdiv, int cdel, axi_eye &eye);
+   // round-trip delay of cable and target in core clock cycles, from the window at the
+   // slowest clock; false if no valid delay
+   bool measureCable(void);
+   // PRBS errors over bits for every delay of divisors 0, divStep, 2*divStep...
+   void captureEyeMap(EyeMap *map, int divStep, uint64_t bits);
+   int getRoundTrip(void) { return roundTrip; };
 
 private:
    AXIDevice *dev;
+   ProbeEngine engine;
+   IdleGate *gate = nullptr;
+   TempSensor *sensor = nullptr;
    int debugLevel = 0;
    bool verbose = false;
+   int berBits = 0;
+   int berOrder = 31;
    int hyst = 0;
+   int mode = CALIB_SEARCH;
+   long probes = 0;
+   int roundTrip = -1;
+   int windowLoss = 0;     // cycles of a TCK period lost to setup, hold and jitter
 
    void printDebug(std::string msg, int lvl);
+   bool probe(int cdel);
+   void setEye(axi_eye &eye, int first, int last);
+   bool slowestEye(axi_eye &eye);
+   bool sweepEye(int cdiv, axi_eye &eye);
+   int searchEdge(int pass, int limit, int guess);
+   bool searchEye(int cdiv, axi_eye *prev, int prevDiv, axi_eye &eye);
+   bool predictEye(int cdiv, axi_eye &eye);
 };
 
 #endif
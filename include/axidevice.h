@@ -32,17 +32,24 @@ typedef struct {
 class AXIDevice : public XVCDriver {
 
 public:
-   AXIDevice(bool v=false, int dl=0);
+   AXIDevice(bool v=false, int dl=0, const char *uio=nullptr);
    ~AXIDevice();
 
    bool detect(void);
    void setClockDelay(int v);
    void setClockDiv(int v);
+   int getClockDelay(void) { return clkdel; };
+   int getClockDiv(void) { return clkdiv; };
+   clock_setting getClockSetting(void) { return {clkdiv, clkdel, false, false}; };
+   void setClockSetting(clock_setting s) { setClockDiv(s.divisor); setClockDelay(s.delay); };
+   std::string getUioDevice(void) { return uiodev; };
    void shift(int nbits, unsigned char *buffer, unsigned char *result);
+   void shiftv(std::vector<shift_segment> &segs) { shiftPacked(segs); };
 
 private:
    int fd;
    volatile jtag_t *ptr;
+   std::string uiodev;
 
    int clkdiv, clkdel;
 };
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <vector>
+#include <map>
 #include <string>
 #include <string.h>
 
@@ -56,6 +57,10 @@ public:
    bool saveFile(std::string filename);
    bool closeFile(void);
 
+   // metadata saved as #key=value lines
+   void setMeta(std::string key, std::string value) { meta[key] = value; };
+   std::string getMeta(std::string key) { return meta.count(key) ? meta[key] : ""; };
+
    void print(void);
    AXICalibItem * getItemById(int id);
    AXICalibItem * getItemByIndex(unsigned int index);
@@ -67,6 +72,7 @@ private:
    FILE *fp;
    bool fileLoaded = false;
    std::vector<AXICalibItem> calibList;
+   std::map<std::string, std::string> meta;
 };
 
 #endif
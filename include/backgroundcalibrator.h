@@ -0,0 +1,62 @@
+#ifndef BACKGROUNDCALIBRATOR_H
+#define BACKGROUNDCALIBRATOR_H
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "xvcdriver.h"
+#include "idlegate.h"
+#include "axicalibrator.h"
+#include "axisetup.h"
+#include "ftdicalibrator.h"
+#include "ftdisetup.h"
+#include "calibcache.h"
+
+/*
+   BackgroundCalibrator runs calibration in a thread while the server already
+   serves clients at a safe clock: probes run in the idle gaps between client
+   shifts, the selected point is validated with a PRBS check and clients are
+   switched to it when the driver is given back
+*/
+
+#define BG_CHECK_BITS   65536    // PRBS bits validating the selected point
+
+class BackgroundCalibrator {
+
+public:
+   BackgroundCalibrator(XVCDriver *d, bool v=false, int dl=0);
+   ~BackgroundCalibrator();
+
+   void setDebugLevel(int lvl) { debugLevel = lvl; };
+   void setVerbose(bool v) { verbose = v; };
+   // point selected as --freq does (-1: max frequency)
+   void setFrequency(int f) { freq = f; };
+   // result saved in the cache when calibration ends
+   void setCache(CalibCache *c) { cache = c; };
+
+   // calibration task, clients run at the current clock setup until it ends
+   void setTask(AXICalibrator *calib, AXISetup *setup, unsigned int calibSize);
+   void setTask(FTDICalibrator *calib, FTDISetup *setup, int minFreq, int maxFreq, int loop);
+   void start(void);
+   bool isDone(void) { return done; };
+
+private:
+   XVCDriver *dev;
+   IdleGate gate;
+   std::thread worker;
+   std::function<void(void)> task;
+   std::atomic<bool> done{false};
+   CalibCache *cache = nullptr;
+   int freq = -1;
+   int debugLevel;
+   bool verbose;
+
+   void printDebug(std::string msg, int lvl);
+   void apply(AXICalibItem *item);
+   void apply(FTDICalibItem *item);
+   template <typename S> bool select(S *setup);
+};
+
+#endif
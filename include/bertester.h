@@ -0,0 +1,72 @@
+#ifndef BERTESTER_H
+#define BERTESTER_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "xvcdriver.h"
+#include "probeengine.h"
+
+/*
+   BERTester streams PRBS sequences through the bypass registers of the JTAG chain
+   in long vectors and counts bit errors: the bit error rate is reported with its
+   95% confidence interval and the achieved bit rate
+*/
+
+#define BER_VECTOR_BITS    16384    // bits of a single probe vector
+#define BER_CONFIDENCE     0.95
+
+// ITU-T O.150 PRBS of polynomial x^order + x^tap + 1
+class PRBSGenerator {
+
+public:
+   PRBSGenerator(int order=31);
+
+   bool setOrder(int order);
+   int getOrder(void) { return order; };
+   void generate(unsigned char *dst, int nbits);
+
+private:
+   int order, tap;
+   std::vector<unsigned char> work;
+};
+
+typedef struct {
+   uint64_t bits;
+   uint64_t errors;
+   double ber;
+   double lower, upper;    // confidence bounds of ber
+   double seconds;
+   double bitRate;         // bit/s of probe vectors
+} ber_result;
+
+class BERTester {
+
+public:
+   BERTester(XVCDriver *d, bool v=false, int dl=0);
+
+   void setDebugLevel(int lvl) { debugLevel = lvl; };
+   void setVerbose(bool v) { verbose = v; };
+
+   bool setPattern(int order) { return prbs.setOrder(order); };
+   void setVectorBits(int n) { vectorBits = n; };
+   void setGate(IdleGate *g) { engine.setGate(g); };
+
+   // stream nbits, stop early when maxErrors (0: no limit) are counted
+   ber_result run(uint64_t nbits, uint64_t maxErrors=0);
+   void printResult(ber_result r);
+
+private:
+   ProbeEngine engine;
+   PRBSGenerator prbs;
+   bool verbose;
+   int debugLevel;
+   int vectorBits = BER_VECTOR_BITS;
+   std::vector<unsigned char> tx;
+
+   void printDebug(std::string msg, int lvl);
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef BITVECTOR_H
+#define BITVECTOR_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+/*
+   Bit vectors are LSB first byte arrays as TMS[], TDI[] and TDO[] of shift(): bulk
+   operations run on SSE2/AVX2 (x86, selected at runtime) or NEON (ARM) kernels,
+   scalar 64-bit kernels are used elsewhere
+*/
+
+typedef struct {
+   const char *name;
+   // nbytes of src funnel shifted right by off (0..7) bits, src holds srcBytes bytes
+   void (*copy)(unsigned char *dst, const unsigned char *src, int off, int nbytes, int srcBytes);
+   // number of differing bits
+   uint64_t (*mismatch)(const unsigned char *a, const unsigned char *b, int nbytes);
+   // 32-bit word repeated on nbytes
+   void (*pattern)(unsigned char *dst, uint32_t word, int nbytes);
+} bit_kernels;
+
+const bit_kernels *bitKernels(void);
+std::vector<const bit_kernels *> bitAvailableKernels(void);
+bool bitSelectKernels(std::string name);
+
+// copy nbits from bit spos of src to bit dpos of dst, other bits of dst are kept;
+// dst may overlap src if it does not come after it
+void bitCopy(unsigned char *dst, int dpos, const unsigned char *src, int spos, int nbits);
+// src shifted right by n bits, nbits - n bits are written to dst
+void bitShiftRight(unsigned char *dst, const unsigned char *src, int nbits, int n);
+bool bitEqual(const unsigned char *a, const unsigned char *b, int nbits);
+uint64_t bitMismatches(const unsigned char *a, const unsigned char *b, int nbits);
+uint64_t bitCount(const unsigned char *a, int nbits);
+// nbits at bit pos set to value
+void bitFill(unsigned char *dst, int pos, int nbits, int value);
+// 32-bit word repeated from bit 0, unused bits of last byte are cleared
+void bitPattern(unsigned char *dst, int nbits, uint32_t word);
+
+// up to 32 bits at bit pos
+static inline uint32_t bitGet(const unsigned char *src, int pos, int n) {
+
+   const unsigned char *s = src + pos / 8;
+   int off = pos & 7;
+   int nbytes = (off + n + 7) / 8;
+   uint64_t v = 0;
+
+   for(int i=0; i<nbytes; i++)
+      v |= (uint64_t) s[i] << (8 * i);
+
+   v >>= off;
+   return (n < 32) ? (uint32_t)(v & ((1ULL << n) - 1)) : (uint32_t) v;
+}
+
+static inline void bitPut(unsigned char *dst, int pos, uint32_t value, int n) {
+
+   unsigned char *d = dst + pos / 8;
+   int off = pos & 7;
+   int nbytes = (off + n + 7) / 8;
+   uint64_t mask = ((n < 32) ? ((1ULL << n) - 1) : 0xFFFFFFFFULL) << off;
+   uint64_t v = ((uint64_t) value << off) & mask;
+
+   for(int i=0; i<nbytes; i++)
+      d[i] = (d[i] & ~(mask >> (8 * i))) | (v >> (8 * i));
+}
+
+// throughput of every available kernel set
+void bitBenchmark(void);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef BROADCASTDEVICE_H
+#define BROADCASTDEVICE_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "xvcdriver.h"
+
+/*
+   BroadcastDevice mirrors every shift on a set of identical JTAG chains:
+   TDO of the primary chain is returned to the client, TDO of the other
+   chains is compared against it to flag mismatching boards
+*/
+
+class BroadcastDevice : public XVCDriver {
+
+typedef struct {
+   std::unique_ptr<XVCDriver> drv;
+   std::thread worker;
+   std::vector<unsigned char> result;
+   unsigned long generation;
+   unsigned long mismatches;
+} chain_t;
+
+public:
+   BroadcastDevice(XVCDriver *primary, bool v=false, int dl=0);
+   ~BroadcastDevice();
+
+   void addChain(XVCDriver *d);
+   int getChainCount(void) { return chains.size() + 1; };
+   unsigned long getMismatchCount(int chain);
+   void printSummary(void);
+
+   void shift(int nbits, unsigned char *buffer, unsigned char *result);
+   void shiftv(std::vector<shift_segment> &segs) { shiftPacked(segs); };
+
+private:
+   XVCDriver *primary;
+   std::vector<std::unique_ptr<chain_t>> chains;
+
+   std::mutex lock;
+   std::condition_variable startCond, doneCond;
+   unsigned long generation = 0;
+   int pending = 0;
+   bool stop = false;
+
+   int curBits = 0;
+   unsigned char *curBuffer = nullptr;
+
+   void run(chain_t *c);
+};
+
+#endif
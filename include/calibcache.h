@@ -0,0 +1,52 @@
+#ifndef CALIBCACHE_H
+#define CALIBCACHE_H
+
+#include <iostream>
+#include <string>
+
+#include "xvcdriver.h"
+#include "axidevice.h"
+#include "axisetup.h"
+#include "axicalibrator.h"
+#include "ftdidevice.h"
+#include "ftdisetup.h"
+
+/*
+   CalibCache keeps one calibration file per driver, port (UIO device or FTDI
+   serial and interface) and target chain in a directory: a cached setup is used
+   when chain and cable fingerprint match and its selected point passes a quick
+   PRBS spot check, otherwise calibration runs again and the entry is replaced
+*/
+
+#define CACHE_RTT_TOLERANCE   4        // AXI round-trip delay units
+#define CACHE_CHECK_BITS      65536    // PRBS bits of the spot check
+
+class CalibCache {
+
+public:
+   CalibCache(std::string d, bool v=false) { dir = d; verbose = v; };
+
+   void setKey(XVCDriver *d, std::string port);
+   std::string getFilename(void);
+
+   // cached setup loaded, validated and applied to the device: calibration can be skipped;
+   // freq selects the point as --freq does (-1: max frequency)
+   bool restore(AXIDevice *d, AXICalibrator *calib, AXISetup *setup, int freq);
+   bool restore(FTDIDevice *d, FTDISetup *setup, int freq);
+
+   bool save(AXISetup *setup);
+   bool save(FTDISetup *setup);
+
+private:
+   std::string dir;
+   bool verbose;
+   std::string driver, port, chain;
+   uint32_t idcode = 0;
+   int rtt = -1;
+
+   template <typename S> bool load(S *setup);
+   template <typename S> void setMeta(S *setup);
+   bool spotCheck(XVCDriver *d);
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef DRIFTMONITOR_H
+#define DRIFTMONITOR_H
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+
+#include "axidevice.h"
+#include "axisetup.h"
+#include "axicalibrator.h"
+#include "idlegate.h"
+#include "backgroundcalibrator.h"
+
+/*
+   DriftMonitor follows the valid capture delay window of the AXI clock setup
+   clients run at: short BYPASS probes in idle gaps check both window edges
+   around their last position, the capture delay is moved back to the window
+   centre when it gets close to an edge and the clock steps down to a slower
+   calibrated point when the window gets too narrow, going back up once the
+   initial point has a wide window again
+*/
+
+#define DRIFT_MIN_EYE      4     // narrowest window clients are kept at
+#define DRIFT_STEPUP       12    // checks between attempts to go back to the initial point
+
+#define DRIFT_DELAY        0     // capture delay moved to window centre
+#define DRIFT_STEP_DOWN    1     // slower calibrated point
+#define DRIFT_STEP_UP      2     // back to the initial point
+#define DRIFT_LOST         3     // no valid point left, clock setup unchanged
+
+typedef struct {
+   time_t time;
+   int type;
+   int fromDiv, fromDelay;
+   int toDiv, toDelay;
+   axi_eye eye;            // window at the new point
+} drift_event;
+
+typedef struct {
+   long checks;
+   long delayShifts;
+   long stepDowns;
+   long stepUps;
+   long lost;
+} drift_metrics;
+
+class DriftMonitor {
+
+public:
+   DriftMonitor(AXIDevice *d, AXICalibrator *c, AXISetup *s, bool v=false, int dl=0);
+   ~DriftMonitor();
+
+   void setDebugLevel(int lvl) { debugLevel = lvl; };
+   void setVerbose(bool v) { verbose = v; };
+   void setPeriod(int sec) { period = sec; };
+
+   // checks start once the background calibration, if any, is finished
+   void start(BackgroundCalibrator *bg=nullptr);
+   void stop(void);
+
+   drift_metrics getMetrics(void);
+   std::vector<drift_event> getEvents(void);
+   void printMetrics(void);
+
+private:
+   AXIDevice *dev;
+   AXICalibrator *calib;
+   AXISetup *setup;
+   IdleGate gate;
+   int debugLevel;
+   bool verbose;
+   int period = 10;
+
+   std::thread worker;
+   std::mutex lock;
+   std::condition_variable stopCond;
+   bool stopped = false;
+
+   clock_setting home;
+   axi_eye eye, homeEye;
+   long lastStep = 0;
+   bool lost = false;
+
+   drift_metrics metrics = {0, 0, 0, 0, 0};
+   std::vector<drift_event> events;
+
+   void printDebug(std::string msg, int lvl);
+   bool wait(int sec);
+   void run(BackgroundCalibrator *bg);
+   void check(void);
+   bool stepDown(int cdiv, int cdel);
+   void record(int type, int cdiv, int cdel, axi_eye &e);
+};
+
+#endif
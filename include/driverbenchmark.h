@@ -0,0 +1,33 @@
+#ifndef DRIVERBENCHMARK_H
+#define DRIVERBENCHMARK_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "xvcdriver.h"
+
+/*
+   DriverBenchmark measures bypass shift throughput of each driver alone and of
+   all drivers running concurrently in separate threads
+*/
+
+#define BENCH_BITS   (256 * 1024)   // bits of a single shift
+#define BENCH_TIME   1.0            // seconds of each measurement
+
+class DriverBenchmark {
+
+public:
+   DriverBenchmark(bool v=false) { verbose = v; };
+
+   void addDriver(XVCDriver *d, std::string label);
+   double measure(XVCDriver *d);
+   void run(void);
+
+private:
+   bool verbose;
+   std::vector<XVCDriver *> drivers;
+   std::vector<std::string> labels;
+};
+
+#endif
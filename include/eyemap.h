@@ -0,0 +1,61 @@
+#ifndef EYEMAP_H
+#define EYEMAP_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "axisetup.h"
+
+/*
+   EyeMap holds PRBS error counts of AXI (divisor, capture delay) cells: each row
+   is a clock divisor with the cells of consecutive delays from its first delay.
+   Maps are saved in a compact binary file and exported as CSV or JSON; the
+   operating point of each row is centred on its error free run, weighted by the
+   error counts of the edges
+*/
+
+#define EYEMAP_MAGIC    "XVCEYE01"
+
+// bits streamed through the cell and errors counted
+typedef struct {
+   uint32_t bits;
+   uint32_t errors;
+} eye_cell;
+
+typedef struct {
+   int cdiv;
+   int firstDelay;
+   std::vector<eye_cell> cells;
+} eye_row;
+
+class EyeMap {
+
+public:
+   void clear(void) { rows.clear(); };
+   void addRow(eye_row &row) { rows.push_back(row); };
+   int getRows(void) { return rows.size(); };
+   eye_row *getRow(unsigned int index) { return (index < rows.size()) ? &rows[index] : nullptr; };
+
+   bool loadFile(std::string filename);
+   bool saveFile(std::string filename);
+   // CSV, or JSON if filename ends with .json
+   bool exportFile(std::string filename);
+
+   // delay of the longest run of error free cells, centred on the run extended by the
+   // good bit share of the cells with errors next to it; false if no error free cell
+   bool getBestDelay(eye_row &row, int &delay, int &points);
+   // one item per row with an error free window of at least cdiv/2 delays
+   void toSetup(AXISetup *setup);
+
+private:
+   std::vector<eye_row> rows;
+
+   bool exportCSV(FILE *fp);
+   bool exportJSON(FILE *fp);
+};
+
+#endif
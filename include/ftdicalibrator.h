@@ -2,15 +2,30 @@
 #define FTDICALIBRATOR_H
 
 #include <vector>
+#include <string>
 
 #include "ftdidevice.h"
 #include "ftdisetup.h"
+#include "bertester.h"
+#include "probeengine.h"
 
 /*
    AXICalibrator is a class to calibrate an AXI device using clock divisor
    and clock delay probing device for a valid idcode
 */
 
+#define FCALIB_SWEEP    0     // every divisor of both sampling edges
+#define FCALIB_SEARCH   1     // bisection of the highest passing divisor of each edge
+#define FCALIB_CHECK    2     // bisection followed by a sweep the boundaries are compared with
+
+#define FCALIB_CONFIRM_POINTS 4  // points below the boundary probed again before it is accepted
+
+typedef struct {
+   bool div5;
+   int divisor;
+   int frequency;
+} clock_point;
+
 class FTDICalibrator {
 
 public:
@@ -20,13 +35,31 @@ public:
    void setDebugLevel(int lvl) { debugLevel = lvl; }; 
    void setVerbose(bool v) { verbose = v; };
 
+   // PRBS bits checked through BYPASS on each candidate point, 0 disables the test
+   void setBERTest(int bits, int order=31) { berBits = bits; berOrder = order; };
+   // calibration run by a background task shares the driver with clients
+   void setGate(IdleGate *g) { gate = g; engine.setGate(g); };
+   void setMode(int m) { mode = m; };
+
    void start(FTDISetup *setup, int minFreq, int maxFreq, int loop);
 
 private:
    FTDIDevice *dev;
+   ProbeEngine engine;
+   IdleGate *gate = nullptr;
    int debugLevel = 0;
    bool verbose = false;
+   int berBits = 0;
+   int berOrder = 31;
+   int mode = FCALIB_SEARCH;
+   long probes = 0;
+   std::vector<clock_point> points;    // ascending frequency
+   std::vector<int> status[2];         // probe result of each point and edge: 1 pass, 0 fail, -1 not probed
 
+   void buildPoints(int minFreq, int maxFreq);
+   bool probe(int index, int tdoSampling, int loop);
+   int getMargin(int index, int tdoSampling);
+   int searchEdge(int tdoSampling, int loop);
    void printDebug(std::string msg, int lvl);
 };
 
@@ -12,6 +12,11 @@
 
 #include "xvcdriver.h"
 #include "devicedb.h"
+#include "mpsseport.h"
+#include "ftdilibport.h"
+#include "ftdiusbport.h"
+#include "ftdisimport.h"
+#include "ftdiplancache.h"
 
 /*
     FTDIDevice is a device driver based on FT2232H USB controller
@@ -22,6 +27,8 @@
 #define DEFAULT_PID	0x6010
 
 #define MAX_DATA     4096
+#define MAX_INFLIGHT 4        // max number of chunks in flight
+#define MIN_CHUNK    256      // min bytes of MPSSE commands per chunk
 
 #define MAX_CFREQ_DIV5_ON  6000000
 #define MIN_CFREQ_DIV5_ON  91.55
@@ -32,18 +39,27 @@
 #define DIV5_ON      true
 #define DIV5_OFF     false
 
+#define BACKEND_LIBFTDI    0
+#define BACKEND_LIBUSB     1
+#define BACKEND_SIM        2
+
 #define POS_EDGE     0x00
 #define NEG_EDGE     MPSSE_READ_NEG    // 0x04
 
 class FTDIDevice : public XVCDriver {
 
 typedef struct {
-   char oper; // 0-byte shift, 1-bit shift, 2-TMS bit shift
-   int len;   // length of the operation
-} data_desc;
+   unsigned char cmd[MAX_DATA];     // MPSSE commands
+   unsigned char res[MAX_DATA];     // MPSSE replies
+   data_desc desc[MAX_DATA];        // read descriptors
+   unsigned char *wrbuf;            // commands to send (cmd or plan template)
+   data_desc *rddesc;               // descriptors to decode (desc or plan)
+   int wr_len, rd_len, desc_len;
+   void *wrxfer, *rdxfer;
+} chunk_t;
 
 public:
-   FTDIDevice(int vid, int pid, enum ftdi_interface interface, const char *serial, char *busconf, bool v=false, int dl=0);
+   FTDIDevice(int vid, int pid, enum ftdi_interface interface, const char *serial, char *busconf, bool v=false, int dl=0, int backend=BACKEND_LIBFTDI);
    ~FTDIDevice();
 
    bool detect(void);
@@ -53,13 +69,42 @@ public:
    void setClockDiv(bool div5, int value);
    void setClockFrequency(int freq);
    void setTDOPosSampling(bool value);
+   bool getClockDiv5(void) { return clkdiv5; };
+   int getClockDiv(void) { return clkdiv; };
+   bool getTDOPosSampling(void) { return (samplingEdge == POS_EDGE); };
+   clock_setting getClockSetting(void) { return {clkdiv, 0, clkdiv5, getTDOPosSampling()}; };
+   void setClockSetting(clock_setting s) { setClockDiv(s.div5, s.divisor); setTDOPosSampling(s.posEdge); };
+
+   void setTransferDepth(int v);
+   int getTransferDepth(void) { return transferDepth; };
+   void setPlanCacheSize(size_t size) { planCache.setMaxSize(size); };
+   FTDIPlanCache *getPlanCache(void) { return &planCache; };
+   void setChunkSize(int v);
+   int getChunkSize(void) { return chunkSize; };
+   void setLatencyTimer(int v);
+   int getLatencyTimer(void) { return latencyTimer; };
+   std::string getSerial(void) { return port->getSerial(); };
 
-   void readBytes(unsigned int len, unsigned char *buf);
    void shift(int nbits, unsigned char *buffer, unsigned char *result);
+   void shiftv(std::vector<shift_segment> &segs) { shiftPacked(segs); };
+
+   bool checkEncoder(int rounds);
 
 private:
-   struct ftdi_context *ftdi;
+   MPSSEPort *port;
    int samplingEdge = NEG_EDGE;
+   bool tmsHigh = true;       // TMS line level, data shift commands do not drive it
+   bool clkdiv5 = DIV5_OFF;
+   int clkdiv = 0x012B;     // 100 kHz set by MPSSE init
+
+   chunk_t chunks[MAX_INFLIGHT];
+   int transferDepth = 2;
+   int chunkSize = MAX_DATA;
+   int latencyTimer = 1;      // ms
+   FTDIPlanCache planCache;
+
+   void encodeChunk(chunk_t *c, unsigned char *buffer, int nr_bytes, int &cur_byte_pos, int &left, std::vector<tdi_patch> *patches);
+   void decodeChunk(chunk_t *c, unsigned char *result, int &bit_pos);
 };
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef FTDILIBPORT_H
+#define FTDILIBPORT_H
+
+#include <stdexcept>
+#include <libftdi1/ftdi.h>
+
+#include "mpsseport.h"
+
+/*
+   FTDILibPort is a MPSSE port based on libftdi
+*/
+
+class FTDILibPort : public MPSSEPort {
+
+public:
+   FTDILibPort(int vid, int pid, enum ftdi_interface interface, const char *serial);
+   ~FTDILibPort();
+
+   int reset(void);
+   int purge(void);
+   int setLatencyTimer(unsigned char value);
+   int setChunkSize(int size);
+   int setBitmode(unsigned char mask, unsigned char mode);
+   std::string getSerial(void);
+   std::string getError(void);
+
+   int write(unsigned char *buf, int len);
+   void *submitWrite(unsigned char *buf, int len);
+   void *submitRead(unsigned char *buf, int len);
+   int wait(void *xfer, int timeout);
+   void cancel(void *xfer);
+
+private:
+   struct ftdi_context *ftdi;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef FTDIPLANCACHE_H
+#define FTDIPLANCACHE_H
+
+#include <iostream>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <stdint.h>
+
+/*
+   FTDIPlanCache keeps compiled MPSSE command streams of recent shifts: a repeated
+   TMS pattern only needs TDI bytes patched into the command template
+*/
+
+#define DEFAULT_PLAN_CACHE   (1024 * 1024)     // bytes
+#define PLAN_TMS_HIGH        0x01              // plan mode flag: TMS line high at start
+
+typedef struct {
+   char oper; // 0-byte shift, 1-bit shift, 2-TMS bits shift
+   int len;   // length of the operation
+} data_desc;
+
+typedef struct {
+   int offset;    // command byte offset
+   int tdi;       // TMS[] TDI[] buffer offset
+   int len;       // bytes to copy
+} tdi_patch;
+
+typedef struct {
+   std::vector<unsigned char> cmd;     // MPSSE commands template
+   std::vector<data_desc> desc;        // read descriptors
+   std::vector<tdi_patch> patches;     // TDI slots in command template
+   int rd_len;
+} plan_chunk;
+
+typedef struct {
+   uint64_t hash;
+   int nbits;
+   int mode;                           // sampling edge and TMS line level at start
+   std::vector<unsigned char> key;     // TMS[] and TDI[] bits held by TMS commands
+   std::vector<plan_chunk> chunks;
+   size_t size;
+} shift_plan;
+
+class FTDIPlanCache {
+
+public:
+   FTDIPlanCache(size_t max=DEFAULT_PLAN_CACHE) { maxSize = max; };
+
+   void setMaxSize(size_t max);
+   size_t getMaxSize(void) { return maxSize; };
+   bool isEnabled(void) { return maxSize > 0; };
+
+   shift_plan *lookup(int nbits, int mode, unsigned char *buffer);
+   void initPlan(shift_plan &plan, int nbits, int mode, unsigned char *buffer);
+   void insert(shift_plan &plan);
+   void clear(void);
+
+   unsigned long getHits(void) { return hits; };
+   unsigned long getMisses(void) { return misses; };
+   unsigned long getEvictions(void) { return evictions; };
+   void printStats(void);
+
+private:
+   size_t maxSize;
+   size_t curSize = 0;
+   unsigned long hits = 0, misses = 0, evictions = 0;
+
+   std::list<shift_plan> plans;    // most recently used first
+   std::unordered_map<uint64_t, std::list<shift_plan>::iterator> index;
+
+   uint64_t hashKey(int nbits, int mode, unsigned char *buffer);
+   bool matchKey(shift_plan &plan, unsigned char *buffer);
+   void evict(void);
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <vector>
+#include <map>
 #include <string>
 #include <string.h>
 
@@ -11,25 +12,31 @@ class FTDICalibItem {
 public:
 	int getId(void) { return id; };
    int getClockDivisor(void) { return clkDiv; };
+   bool getClockDiv5(void) { return clkDiv5; };
 	bool getTDOSampling(void) { return tdoSam; };
    int getClockFrequency(void) { return clkFreq; };
+   int getMargin(void) { return margin; };
 
    void setId(int v) { id = v; };
    void setClockDivisor(int v) { clkDiv = v; };
+   void setClockDiv5(bool v) { clkDiv5 = v; };
 	void setTDOSampling(bool v) { tdoSam = v; };
    void setClockFrequency(int v) { clkFreq = v; };
+   void setMargin(int v) { margin = v; };
 
    void print(void) {
-      std::cout << "ID: " << id << " DIV:" << clkDiv << " TDOSAM:" << tdoSam <<
-         " FREQ:" << clkFreq << std::endl;
+      std::cout << "ID: " << id << " DIV:" << clkDiv << (clkDiv5 ? " DIV5" : "") << " TDOSAM:" << tdoSam <<
+         " FREQ:" << clkFreq << " MARGIN:" << margin << std::endl;
    }
 
 
 private:
    int id;
    int clkDiv;
+   bool clkDiv5 = false;   // 12 MHz base clock for frequencies below the 60 MHz divisor range
 	bool tdoSam;
    int clkFreq;
+   int margin = -1;        // % of the TCK period to the nearest failing point, -1 if unknown
 };
 
 class FTDISetup {
@@ -40,7 +47,9 @@ public:
    ~FTDISetup();
 
    void setVerbose(bool v) { verbose = v; };
+   int getListSize(void) { return calibList.size(); };
    void addItem(FTDICalibItem &item);
+   void delItemById(int id);
    void clear(void);
    void finalize(void);
 
@@ -48,8 +57,13 @@ public:
    bool saveFile(std::string filename);
    bool closeFile(void);
 
+   // metadata saved as #key=value lines
+   void setMeta(std::string key, std::string value) { meta[key] = value; };
+   std::string getMeta(std::string key) { return meta.count(key) ? meta[key] : ""; };
+
    void print(void);
    FTDICalibItem * getItemById(int id);
+   FTDICalibItem * getItemByIndex(unsigned int index);
    FTDICalibItem * getItemByFrequency(int freq);
    FTDICalibItem * getItemByMaxFrequency(void);
 
@@ -58,6 +72,7 @@ private:
    FILE *fp;
    bool fileLoaded = false;
    std::vector<FTDICalibItem> calibList;
+   std::map<std::string, std::string> meta;
 };
 
 #endif
@@ -0,0 +1,88 @@
+#ifndef FTDISIMPORT_H
+#define FTDISIMPORT_H
+
+#include <stdexcept>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+#include <libftdi1/ftdi.h>
+
+#include "mpsseport.h"
+
+/*
+   FTDISimPort is a MPSSE port without hardware: commands are interpreted by a
+   software MPSSE engine connected to a simulated JTAG chain, USB traffic and
+   TCK wire time are accounted to test and benchmark the FTDI encoder offline
+*/
+
+// simulated device of the JTAG chain
+typedef struct {
+   uint32_t idcode;
+   int irlen;
+   uint32_t idcmd;
+   uint64_t ir;         // instruction register
+   uint64_t irsh;       // instruction shift register
+   uint64_t dr;         // selected data shift register
+   int drlen;
+} sim_device;
+
+class FTDISimPort : public MPSSEPort {
+
+public:
+   // chain is a comma separated list of IDCODEs, first device is nearest to TDO (default: XC7A35T)
+   FTDISimPort(const char *chain);
+   ~FTDISimPort();
+
+   int reset(void);
+   int purge(void);
+   int setLatencyTimer(unsigned char value);
+   int setChunkSize(int size);
+   int setBitmode(unsigned char mask, unsigned char mode);
+   std::string getSerial(void);
+   std::string getError(void);
+
+   int write(unsigned char *buf, int len);
+   void *submitWrite(unsigned char *buf, int len);
+   void *submitRead(unsigned char *buf, int len);
+   int wait(void *xfer, int timeout);
+   void cancel(void *xfer);
+
+   uint64_t getBytesOut(void) { return bytesOut; };
+   uint64_t getBytesIn(void) { return bytesIn; };
+   uint64_t getTransfers(void) { return transfers; };
+   uint64_t getTCKCount(void) { return tcks; };
+   double getWireTime(void) { return wireTime; };
+   void printStats(void);
+
+   // scalar reference of the encoder: checkpoint() saves the chain, referenceShift() clocks
+   // the saved chain bit by bit and tells if it ends as the chain driven by MPSSE commands
+   void checkpoint(void);
+   bool referenceShift(int nbits, unsigned char *buffer, unsigned char *result);
+
+private:
+   std::vector<sim_device> chain;
+   int state;                          // TAP state
+   std::vector<sim_device> savedChain; // chain at checkpoint
+   int savedState = 0;
+   bool mpsse = false;
+   bool loopback = false;
+   bool div5 = true;
+   int divisor = 0;
+   unsigned char lowPins = 0, lowDir = 0, highPins = 0, highDir = 0;
+
+   std::vector<unsigned char> pending; // incomplete command of last write
+   std::deque<unsigned char> replies;  // bytes waiting to be read
+   std::string error;
+
+   uint64_t bytesOut = 0, bytesIn = 0, transfers = 0, tcks = 0;
+   double wireTime = 0;                // seconds of TCK activity
+
+   void resetChain(void);
+   int clock(int tms, int tdi);
+   int commandLength(unsigned char *cmd, int len);
+   void execute(unsigned char *cmd);
+   int process(unsigned char *buf, int len);
+   int read(unsigned char *buf, int len);
+};
+
+#endif
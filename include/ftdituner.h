@@ -0,0 +1,54 @@
+#ifndef FTDITUNER_H
+#define FTDITUNER_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "ftdidevice.h"
+
+/*
+   FTDITuner sweeps USB transfer settings of a FTDIDevice (chunk size, latency timer,
+   chunks in flight) with bypass shifts and applies the fastest one; results are
+   stored per adapter serial number
+*/
+
+#define DEFAULT_TUNE_FILE  "ftditune.txt"
+
+typedef struct {
+   int chunkSize;
+   int latency;
+   int depth;
+   double rtt;          // us
+   double throughput;   // bit/s
+} ftdi_tuning;
+
+class FTDITuner {
+
+public:
+   FTDITuner(FTDIDevice *d);
+
+   void setVerbose(bool v) { verbose = v; };
+   void setDebugLevel(int lvl) { debugLevel = lvl; };
+
+   bool run(void);
+   ftdi_tuning getResult(void) { return best; };
+
+   bool loadFile(std::string filename);
+   bool saveFile(std::string filename);
+
+private:
+   FTDIDevice *dev;
+   std::string serial;
+   ftdi_tuning best;
+   bool verbose = false;
+   int debugLevel = 0;
+
+   std::vector<unsigned char> buffer, result, reference;
+
+   void apply(ftdi_tuning &t);
+   double measureRTT(void);
+   double measureThroughput(bool &valid);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef FTDIUSBPORT_H
+#define FTDIUSBPORT_H
+
+#include <stdexcept>
+#include <libftdi1/ftdi.h>
+#include <libusb-1.0/libusb.h>
+
+#include "mpsseport.h"
+
+/*
+   FTDIUsbPort is a MPSSE port that drives FTDI bulk endpoints directly with libusb-1.0
+*/
+
+#define USB_MAX_WRITES     8        // pre-allocated write transfers
+#define USB_READ_SIZE      16384    // raw read buffer (multiple of max packet size)
+#define USB_CANCEL_TIMEOUT 1000     // ms a cancelled transfer is waited for
+
+// FTDI vendor requests, raw codes apart from libftdi names
+#define USB_SIO_RESET               0x00
+#define USB_SIO_SET_LATENCY         0x09
+#define USB_SIO_SET_BITMODE         0x0B
+
+#define USB_SIO_RESET_SIO           0
+#define USB_SIO_PURGE_RX            1
+#define USB_SIO_PURGE_TX            2
+
+#define FTDI_STATUS_BYTES           2     // modem status bytes on top of each IN packet
+
+class FTDIUsbPort : public MPSSEPort {
+
+typedef struct {
+   struct libusb_transfer *xfer;
+   FTDIUsbPort *port;
+   unsigned char *dst;     // destination buffer (read)
+   int size;               // requested bytes
+   int done;               // transferred bytes (payload for read)
+   int completed;          // 0: in flight, 1: completed
+   bool cancelling;        // no resubmission once cancel is requested
+   bool busy;
+} usb_xfer_t;
+
+public:
+   FTDIUsbPort(int vid, int pid, enum ftdi_interface interface, const char *serial);
+   ~FTDIUsbPort();
+
+   int reset(void);
+   int purge(void);
+   int setLatencyTimer(unsigned char value);
+   int setChunkSize(int size);
+   int setBitmode(unsigned char mask, unsigned char mode);
+   std::string getSerial(void) { return serialNumber; };
+   std::string getError(void) { return error; };
+
+   int write(unsigned char *buf, int len);
+   void *submitWrite(unsigned char *buf, int len);
+   void *submitRead(unsigned char *buf, int len);
+   int wait(void *xfer, int timeout);
+   void cancel(void *xfer);
+
+private:
+   libusb_context *ctx = nullptr;
+   libusb_device_handle *handle = nullptr;
+   int ifnum, index;
+   unsigned char inEp, outEp;
+   int maxPacket = 512;
+   int readSize = USB_READ_SIZE;          // max bytes of an IN transfer
+   std::string serialNumber;
+   std::string error;
+
+   usb_xfer_t writes[USB_MAX_WRITES];
+   usb_xfer_t reads;
+   unsigned char rawbuf[USB_READ_SIZE];
+   unsigned char spill[USB_READ_SIZE];    // replies received beyond current read
+   int spillLen = 0;
+
+   int control(uint8_t request, uint16_t value);
+   int submitReadPackets(void);
+   void unpack(unsigned char *raw, int len, usb_xfer_t *x);
+   void finish(usb_xfer_t *x);
+
+   static void writeCallback(struct libusb_transfer *xfer);
+   static void readCallback(struct libusb_transfer *xfer);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef IDLEGATE_H
+#define IDLEGATE_H
+
+#include <iostream>
+#include <vector>
+
+#include "xvcdriver.h"
+#include "jtagsequence.h"
+
+/*
+   IdleGate lets a background task use a driver in the idle gaps between client
+   shifts: the task runs holding the driver lock and gives it back as soon as a
+   client shift is waiting, client clock setup, TAP state and instruction are
+   restored then; the task enters only while the TAP rests in TEST-LOGIC-RESET or
+   in RUN-TEST/IDLE with a known instruction, so gaps inside a client session
+   are used too: the client finds the instruction it loaded last
+*/
+
+#define IDLE_GAP     0.2      // seconds without client shifts before a task enters
+#define IDLE_POLL    10000    // us between idle checks
+
+class IdleGate {
+
+public:
+   IdleGate(XVCDriver *d, double g=IDLE_GAP);
+
+   // wait for an idle gap and lock the driver, clock setup of the task is applied
+   void enter(void);
+   // client clock setup and TAP state restored, driver unlocked
+   void leave(void);
+   // leave and enter again if a client shift is waiting, true if the task yielded
+   bool yield(void);
+
+   // clock setup clients run at, applied on next leave
+   void setClientClock(clock_setting s) { client = s; };
+   clock_setting getClientClock(void) { return client; };
+   long getYields(void) { return yields; };
+
+private:
+   XVCDriver *dev;
+   double gap;
+   bool inside = false;
+   bool taskClockSet = false;
+   int clientState = TAP_UNKNOWN;
+   std::vector<unsigned char> clientIr;
+   int clientIrBits = -1;
+   clock_setting client, task;
+   long yields = 0;
+   JTAGSequence seq;
+};
+
+#endif
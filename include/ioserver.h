@@ -9,8 +9,23 @@
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <string.h>
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
 
 #include "xvcdriver.h"
+#include "asyncdriver.h"
+
+#define MAX_BATCH    64    // max shift commands executed in a single driver transaction
+
+// shift commands received together, TMS[]/TDI[] of each command are stored back to back
+typedef struct {
+   std::vector<unsigned char> data, result;
+   std::vector<int> lengths;
+   std::vector<shift_segment> segs;
+   std::future<void> done;
+} shift_batch;
 
 /*
    IOServer opens TCP connection for XVC server and use XVCDriver to shift in/out buffers
@@ -27,15 +42,28 @@ private:
    int vectorLength = 32768;
 
    XVCDriver *drv;
+   std::function<void(bool open)> sessionHook;
 
    bool handleData(int fd);
+   void closeSession(int fd);
    std::string xvcInfo;
 
    unsigned char *buffer = nullptr;
    unsigned char *result = nullptr;
 
    int sread(int fd, void *target, int len);
-   
+
+   std::vector<unsigned char> batchBuffer, batchResult;
+   std::vector<shift_segment> segments;
+   int queuedShift(int fd, int size);
+   int readQueued(int fd, std::vector<unsigned char> &data, std::vector<int> &lengths, int max);
+
+   std::unique_ptr<AsyncDriver> adrv;
+   shift_batch batches[2];
+   void submitBatch(shift_batch &b);
+   bool replyBatch(int fd, shift_batch &b);
+   bool pipelineShifts(int fd);
+
 public:
    IOServer(XVCDriver *driver);
    ~IOServer();
@@ -44,6 +72,9 @@ public:
    void setPort(int p) { port = p; }
    void setVerbose(bool v) { verbose = v; }
    void setVectorLength(int v);
+   void setAsync(bool a);
+   // called when a client connection is accepted (open) and when it is closed
+   void setSessionHook(std::function<void(bool open)> hook) { sessionHook = hook; }
 };
 
 #endif
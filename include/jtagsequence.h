@@ -0,0 +1,89 @@
+#ifndef JTAGSEQUENCE_H
+#define JTAGSEQUENCE_H
+
+#include <vector>
+#include <stdint.h>
+
+/*
+   JTAGSequence builds a whole JTAG transaction (state moves, IR and DR scans) into a
+   single TMS[]/TDI[] buffer for one shift(): moves take the shortest TMS path of the
+   TAP state machine and TDO of each scan is copied back after the shift
+*/
+
+enum tap_state {
+   TAP_UNKNOWN = -1,
+   TAP_RESET = 0,       // TEST-LOGIC-RESET
+   TAP_IDLE,            // RUN-TEST/IDLE
+   TAP_SELECT_DR,
+   TAP_CAPTURE_DR,
+   TAP_SHIFT_DR,
+   TAP_EXIT1_DR,
+   TAP_PAUSE_DR,
+   TAP_EXIT2_DR,
+   TAP_UPDATE_DR,
+   TAP_SELECT_IR,
+   TAP_CAPTURE_IR,
+   TAP_SHIFT_IR,
+   TAP_EXIT1_IR,
+   TAP_PAUSE_IR,
+   TAP_EXIT2_IR,
+   TAP_UPDATE_IR,
+   TAP_STATES
+};
+
+// next TAP state on a TCK cycle
+int tapNextState(int state, int tms);
+const char *tapStateName(int state);
+
+// bits of the other devices of the chain around the target device, pre is on TDO side
+typedef struct {
+   int irPre, irPost;   // instruction register bits, filled with ones (BYPASS)
+   int drPre, drPost;   // bypass register bits, filled with zeros
+} scan_padding;
+
+typedef struct {
+   int pos;             // first bit of scan in sequence
+   int nbits;
+   unsigned char *tdo;
+} tdo_capture;
+
+class JTAGSequence {
+
+public:
+   JTAGSequence(int bits=1024);
+
+   // start a new sequence from state, TAP_UNKNOWN adds TEST-LOGIC-RESET on first move
+   void begin(int state);
+
+   void reset(void);
+   void gotoState(int state);
+   void clocks(int n);
+
+   // scans of the target device, padding applies to following scans
+   void setPadding(scan_padding p) { padding = p; };
+
+   // scan ends in EXIT1 on last bit then moves to end, with end as the shift state TAP stays there
+   void irScan(int nbits, const unsigned char *tdi, unsigned char *tdo=nullptr, int end=TAP_IDLE);
+   void drScan(int nbits, const unsigned char *tdi, unsigned char *tdo=nullptr, int end=TAP_IDLE);
+
+   int getState(void) { return state; };
+   int getBits(void) { return nbits; };
+
+   // TMS[] followed by TDI[] as shift() buffer, result holds TDO of the whole sequence
+   unsigned char *getBuffer(void);
+   unsigned char *getResult(void) { return result.data(); };
+   void scatter(void);
+
+private:
+   std::vector<unsigned char> tms, tdi, buffer, result;
+   std::vector<tdo_capture> captures;
+   int nbits = 0;
+   int state = TAP_UNKNOWN;
+   scan_padding padding = {0, 0, 0, 0};
+
+   void grow(int n);
+   void addBits(int n, uint64_t tmsBits);
+   void scan(int shiftState, int pre, int n, int post, const unsigned char *data, unsigned char *tdo, int end);
+};
+
+#endif
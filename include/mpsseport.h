@@ -0,0 +1,46 @@
+#ifndef MPSSEPORT_H
+#define MPSSEPORT_H
+
+#include <iostream>
+#include <string>
+
+#define USB_TIMEOUT  1000     // USB transfer timeout (ms)
+
+/*
+   MPSSEPort is an abstract class to specialize with a USB backend that moves
+   MPSSE command and reply streams between FTDIDevice and a FTDI chip
+*/
+
+class MPSSEPort {
+
+public:
+   virtual ~MPSSEPort() {};
+
+   std::string getName(void) { return name; };
+
+   virtual int reset(void) = 0;
+   virtual int purge(void) = 0;
+   virtual int setLatencyTimer(unsigned char value) = 0;
+   virtual int setChunkSize(int size) = 0;      // max bytes of a single USB transfer
+   virtual int setBitmode(unsigned char mask, unsigned char mode) = 0;
+   virtual std::string getSerial(void) = 0;
+   virtual std::string getError(void) = 0;
+
+   // synchronous write of len bytes, returns bytes written or < 0 on error
+   virtual int write(unsigned char *buf, int len) = 0;
+
+   // asynchronous transfers: a submitted transfer must be completed with wait or cancel,
+   // wait returns transferred bytes or < 0 on error/timeout (ms)
+   virtual void *submitWrite(unsigned char *buf, int len) = 0;
+   virtual void *submitRead(unsigned char *buf, int len) = 0;
+   virtual int wait(void *xfer, int timeout) = 0;
+   virtual void cancel(void *xfer) = 0;
+
+protected:
+   void setName(std::string n) { name = n; };
+
+private:
+   std::string name;
+};
+
+#endif
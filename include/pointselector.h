@@ -0,0 +1,71 @@
+#ifndef POINTSELECTOR_H
+#define POINTSELECTOR_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "xvcdriver.h"
+#include "axidevice.h"
+#include "axisetup.h"
+#include "ftdidevice.h"
+#include "ftdisetup.h"
+
+/*
+   PointSelector chooses the calibrated point the server runs at by policy:
+      MAXFREQ              highest clock frequency
+      MARGIN:<pct>         highest clock frequency with at least pct% margin
+      THROUGHPUT[:<pct>]   highest measured PRBS throughput without bit errors
+                           (and at least pct% margin), the widest margin wins
+                           among points within POLICY_TOLERANCE of the best one
+   margin is the eye width for AXI points and the distance to the nearest failing
+   point of the same TDO sampling edge found by calibration for FTDI points, both
+   in % of the TCK period
+*/
+
+#define POLICY_MAXFREQ      0
+#define POLICY_MARGIN       1
+#define POLICY_THROUGHPUT   2
+
+#define POLICY_TOLERANCE    0.05     // relative throughput difference of equivalent points
+#define POLICY_CHECK_BITS   1000000  // default PRBS bits measured on each point
+
+typedef struct {
+   int index;           // position in the setup list
+   int id;
+   int frequency;
+   int margin;          // %
+   double throughput;   // bit/s, 0 if not measured
+   uint64_t errors;
+} point_score;
+
+class PointSelector {
+
+public:
+   PointSelector(bool v=false, int dl=0) { verbose = v; debugLevel = dl; };
+
+   // false if policy is not valid
+   bool setPolicy(std::string p);
+   std::string getPolicy(void) { return name; };
+   void setCheckBits(uint64_t bits) { checkBits = bits; };
+   void setPattern(int order) { prbsOrder = order; };
+
+   // chosen point is left applied to the device, nullptr if no point satisfies the policy
+   AXICalibItem *select(AXIDevice *d, AXISetup *setup);
+   FTDICalibItem *select(FTDIDevice *d, FTDISetup *setup);
+
+private:
+   bool verbose;
+   int debugLevel;
+   int policy = POLICY_MAXFREQ;
+   int minMargin = 0;
+   std::string name = "MAXFREQ";
+   uint64_t checkBits = POLICY_CHECK_BITS;
+   int prbsOrder = 31;
+
+   void printDebug(std::string msg, int lvl);
+   int choose(XVCDriver *d, std::vector<point_score> &points, std::function<void(int index)> apply);
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef PROBEENGINE_H
+#define PROBEENGINE_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "xvcdriver.h"
+#include "jtagsequence.h"
+#include "idlegate.h"
+
+/*
+   ProbeEngine runs the probes of calibration and bit error tests: the TAP enters
+   BYPASS once per operating point and test vectors are streamed in SHIFT-DR, each
+   probe is a single shift whose result is compared in bulk
+*/
+
+class ProbeEngine {
+
+public:
+   ProbeEngine(XVCDriver *d);
+
+   // clock settings changed: the TAP is moved to BYPASS again before next probe
+   void invalidate(void) { ready = false; };
+   // probes of a background task give the driver back to waiting clients first
+   void setGate(IdleGate *g) { gate = g; };
+
+   // nbits of tdi through the bypass registers, returns number of mismatching bits
+   uint64_t probeBits(const unsigned char *tdi, int nbits, unsigned char *tdo=nullptr);
+   // true if every word is read back
+   bool probeWords(const std::vector<uint32_t> &words);
+   // n IDCODE captures of the target device in one shift, returns number of valid ones
+   int probeIdCodes(int n);
+
+   long getShifts(void) { return shifts; };
+   long getNavigations(void) { return navigations; };
+
+private:
+   XVCDriver *dev;
+   IdleGate *gate = nullptr;
+   JTAGSequence seq;
+   bool ready = false;
+   bool failed = false;
+   long shifts = 0;
+   long navigations = 0;
+   std::vector<unsigned char> data, result;
+
+   void enterBypass(void);
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef TEMPSENSOR_H
+#define TEMPSENSOR_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "xvcdriver.h"
+#include "jtagsequence.h"
+
+/*
+   TempSensor reads the die temperature of the target device through the DRP port
+   of the 7-series XADC or UltraScale SYSMON: a DRP read command is shifted in the
+   XADC_DRP data register and its result comes out of the next DR scan
+*/
+
+#define XILINX_MANUFACTURER 0x049  // JEDEC code of IDCODE bits 11:1
+#define XADC_DRP_CMD    0x37     // XADC_DRP/SYSMON_DRP instruction of 6 bit IR devices
+#define ZYNQMP_DRP_CMD  0x937    // SYSMON_DRP instruction of Zynq UltraScale+ 12 bit IR (PS and PL TAPs)
+#define XADC_DRP_READ   0x1      // DRP command field
+#define XADC_TEMP_ADDR  0x00     // temperature status register
+
+#define SENSOR_XADC     0        // 7-series XADC
+#define SENSOR_SYSMON   1        // UltraScale SYSMONE1
+#define SENSOR_SYSMON4  2        // UltraScale+ SYSMONE4
+
+class TempSensor {
+
+public:
+   TempSensor(XVCDriver *d, bool v=false, int dl=0);
+
+   void setDebugLevel(int lvl) { debugLevel = lvl; };
+   void setVerbose(bool v) { verbose = v; };
+
+   // die temperature in Celsius at current clock setup, false if the register
+   // can't be read or holds no conversion
+   bool read(double &celsius);
+
+private:
+   XVCDriver *dev;
+   JTAGSequence seq;
+   int type;
+   bool xilinx;
+   int drpIrLen;           // IR length the DRP instruction is known for
+   uint32_t drpCmd;
+   int debugLevel;
+   bool verbose;
+   std::vector<unsigned char> result;
+
+   void printDebug(std::string msg, int lvl);
+};
+
+#endif
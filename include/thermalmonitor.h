@@ -0,0 +1,84 @@
+#ifndef THERMALMONITOR_H
+#define THERMALMONITOR_H
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "axidevice.h"
+#include "axisetup.h"
+#include "axicalibrator.h"
+#include "idlegate.h"
+#include "tempsensor.h"
+#include "thermaltables.h"
+
+/*
+   ThermalMonitor reads the die temperature of the target between client sessions
+   and moves clients to the calibration table of the temperature band when it
+   changes; a band without a valid table is calibrated in the idle gaps between
+   client shifts and its table saved, clients keep their clock setup meanwhile
+*/
+
+typedef struct {
+   long samples;
+   long readErrors;
+   long switches;
+   long calibrations;
+} thermal_metrics;
+
+class ThermalMonitor {
+
+public:
+   ThermalMonitor(AXIDevice *d, AXICalibrator *c, TempSensor *s, ThermalTables *t, bool v=false, int dl=0);
+   ~ThermalMonitor();
+
+   void setDebugLevel(int lvl) { debugLevel = lvl; };
+   void setVerbose(bool v) { verbose = v; };
+   void setPeriod(int sec) { period = sec; };
+   // point selected as --freq does (-1: max frequency)
+   void setFrequency(int f) { freq = f; };
+   void setCalibSize(unsigned int n) { calibSize = n; };
+
+   // band of the table clients run at when the monitor starts
+   void start(int band);
+   void stop(void);
+   // client connection accepted (open) or closed, samples wait for the end of open sessions
+   void session(bool open);
+
+   thermal_metrics getMetrics(void);
+   void printMetrics(void);
+
+private:
+   AXIDevice *dev;
+   AXICalibrator *calib;
+   TempSensor *sensor;
+   ThermalTables *tables;
+   AXISetup *table;        // table of the band being switched to
+   IdleGate gate;
+   int debugLevel;
+   bool verbose;
+   int period = 30;
+   int freq = -1;
+   unsigned int calibSize = 0;
+   int band = 0;
+   int sessions = 0;       // open client connections
+   clock_setting client;   // clock setup clients run at
+   JTAGSequence seq;
+
+   std::thread worker;
+   std::mutex lock;
+   std::condition_variable wakeCond;
+   bool stopped = false;
+
+   thermal_metrics metrics = {0, 0, 0, 0};
+
+   void printDebug(std::string msg, int lvl);
+   bool wait(int sec);
+   void run(void);
+   bool check(void);
+   bool sample(double &celsius, bool &failed);
+   bool calibrate(AXISetup *setup, int next);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef THERMALTABLES_H
+#define THERMALTABLES_H
+
+#include <iostream>
+#include <string>
+
+#include "xvcdriver.h"
+#include "axidevice.h"
+#include "axisetup.h"
+
+/*
+   ThermalTables keeps one AXI calibration file per die temperature band of the
+   target in a directory: the table of a band is used while the temperature stays
+   in it, a band is left only past its edges by THERMAL_HYST so that a temperature
+   at an edge doesn't switch tables back and forth
+*/
+
+#define THERMAL_BAND        10       // default band width in Celsius
+#define THERMAL_HYST        2.0      // Celsius past a band edge before the band changes
+#define THERMAL_CHECK_BITS  65536    // PRBS bits of the spot check of a table point
+
+class ThermalTables {
+
+public:
+   ThermalTables(std::string d, int w=THERMAL_BAND, bool v=false);
+
+   void setKey(XVCDriver *d);
+   int getWidth(void) { return width; };
+
+   int getBand(double celsius);
+   // band of celsius, current band kept within its hysteresis
+   int nextBand(int band, double celsius);
+   // lowest temperature of a band, as used in file names
+   int getBandFloor(int band) { return band * width; };
+   std::string getFilename(int band);
+
+   // table of band loaded, its point selected as --freq does (-1: max frequency) is
+   // applied to the device and passes a PRBS spot check
+   bool restore(AXIDevice *d, AXISetup *setup, int band, int freq);
+   bool save(AXISetup *setup, int band);
+
+private:
+   std::string dir;
+   int width;
+   bool verbose;
+   uint32_t idcode = 0;
+};
+
+#endif
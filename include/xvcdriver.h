@@ -4,6 +4,39 @@
 #include <iostream>
 #include <vector>
 #include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "jtagsequence.h"
+
+// segment of a batched shift, TDO (nbits rounded up to bytes) is not returned if tdo is null
+typedef struct {
+   int nbits;
+   const unsigned char *tms;
+   const unsigned char *tdi;
+   unsigned char *tdo;
+} shift_segment;
+
+#define MAX_CHAIN_DEVICES   32
+#define MAX_CHAIN_IRLEN     1024     // bits of all instruction registers of the chain
+
+// device of the JTAG chain, idcode is 0 for devices in BYPASS after reset
+typedef struct {
+   uint32_t idcode;
+   int irlen;
+   int idcmd;
+   std::string desc;
+} chain_device;
+
+// clock setup of a driver: AXI divisor and capture delay, FTDI divisor and TDO sampling edge
+typedef struct {
+   int divisor;
+   int delay;
+   bool div5;
+   bool posEdge;
+} clock_setting;
 
 /*
    XVCDriver is an abstract class to specialize with a driver that use hardware 
@@ -14,39 +47,106 @@ class XVCDriver {
 
 public:
    XVCDriver();
-   ~XVCDriver() {};
+   virtual ~XVCDriver() {};
 
    std::string getName(void) { return name; };
    void setDebugLevel(int lvl) { debugLevel = lvl; };
    void setVerbose(bool v) { verbose = v; };
 
    virtual void shift(int nbits, unsigned char *buffer, unsigned char *result) = 0;
+   virtual void shiftv(std::vector<shift_segment> &segs);
    uint32_t scanChain(void);
    uint32_t probeIdCode(void);
+   // first 32 DR bits after TEST-LOGIC-RESET, no IR scan: IDCODE of the device nearest
+   // to TDO, or its BYPASS bit followed by the next device
+   uint32_t probeResetCode(void);
    void startBypass(void);
    uint32_t probeBypass(const uint32_t value); 
    std::vector<uint32_t> probeBypass(const std::vector<uint32_t> data);
+   // bit vector through the bypass registers, returns count of mismatching bits
+   uint64_t probeBypassBits(const unsigned char *tdi, int nbits, unsigned char *tdo=nullptr);
    bool isDetected(void) { return detected; };
 
+   // TAP state after the last shift, from TMS of every shift (client traffic included)
+   int getTapState(void) { return tapState; };
+   // instruction bits of the whole chain loaded by the last Update-IR, from TDI of every shift:
+   // returns their number, 0 after TEST-LOGIC-RESET (reset instruction), -1 if unknown
+   int getInstruction(std::vector<unsigned char> &ir);
+   void runSequence(JTAGSequence &s);
+
+   // devices found by scanChain, index 0 is nearest to TDO
+   std::vector<chain_device> getChain(void) { return chain; };
+   bool selectDevice(int index);
+   int getSelectedDevice(void) { return target; };
+   // bits of the other devices around the target device in IR and DR scans
+   scan_padding getPadding(void) { return padding; };
+
+   // clock setup saved and restored by background tasks
+   virtual clock_setting getClockSetting(void) { return {0, 0, false, false}; };
+   virtual void setClockSetting(clock_setting s) {};
+
+   // client shifts and background tasks share the driver: clients hold the lock
+   // for each shift, background tasks yield it when a client is waiting
+   void clientLock(void);
+   void clientUnlock(void);
+   std::mutex &getLock(void) { return shareLock; };
+   bool isClientWaiting(void) { return clientWaiting > 0; };
+   // seconds since the last client shift
+   double getIdleTime(void);
+
    uint32_t getIdCode(void) { return idcode; };
    int getIdCmd(void) { return idcmd; };
    int getIrLen(void) { return irlen; };
    std::string getDescription(void) { return desc; }
 
 protected:
-   uint32_t idcode;
-   int idcmd, irlen;
+   uint32_t idcode = 0;
+   int idcmd = 0, irlen = 0;
    std::string desc;
 
    int debugLevel = 0;
    bool verbose = false;
    bool detected = false;
 
+   std::vector<chain_device> chain;
+   int target = -1;
+   scan_padding padding = {0, 0, 0, 0};
+
    void setName(std::string n) { name = n; };
    void printDebug(std::string msg, int lvl);
+   void shiftPacked(std::vector<shift_segment> &segs);
+   void trackTMS(int nbits, const unsigned char *tms, const unsigned char *tdi);
 
 private:
    std::string name;
+   std::vector<unsigned char> packBuffer, packResult;
+
+   int tapState = TAP_UNKNOWN;
+   int tmsHighCount = 0;               // consecutive TMS high bits while state is unknown
+   unsigned char irShift[MAX_CHAIN_IRLEN / 8], irValue[MAX_CHAIN_IRLEN / 8];
+   int irShiftBits = 0;                // TDI bits shifted since Capture-IR
+   int irBits = -1;                    // instruction bits loaded by Update-IR
+
+   std::mutex shareLock;
+   std::atomic<int> clientWaiting{0};
+   std::atomic<int64_t> lastClientShift{0};  // steady clock ns
+
+   JTAGSequence seq;
+   std::vector<unsigned char> probeData, probeResult;
+
+   void addBypassScan(void);
+   bool assignIrLengths(std::vector<chain_device> &devs, const unsigned char *capture, int irtotal);
+};
+
+// client shift scope on a shared driver
+class ClientLock {
+
+public:
+   ClientLock(XVCDriver *d) { dev = d; dev->clientLock(); };
+   ~ClientLock() { dev->clientUnlock(); };
+
+private:
+   XVCDriver *dev;
 };
 
 #endif
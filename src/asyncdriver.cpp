@@ -0,0 +1,138 @@
+#include "asyncdriver.h"
+
+AsyncDriver::AsyncDriver(XVCDriver *d, bool v, int dl) {
+
+   drv = d;
+   verbose = v;
+   debugLevel = dl;
+   setName(drv->getName());
+
+   // expose wrapped driver target
+   idcode = drv->getIdCode();
+   idcmd = drv->getIdCmd();
+   irlen = drv->getIrLen();
+   desc = drv->getDescription();
+   detected = drv->isDetected();
+
+   worker = std::thread(&AsyncDriver::run, this);
+}
+
+AsyncDriver::~AsyncDriver() {
+
+   // queued operations are completed before exit
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+   }
+   queueCond.notify_all();
+   worker.join();
+
+   if(verbose && transactions)
+      printf("AsyncDriver: %lu operations in %lu driver transactions\n", jobs, transactions);
+}
+
+void AsyncDriver::enqueue(async_job job) {
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      queue.push_back(std::move(job));
+      pending++;
+   }
+   queueCond.notify_one();
+}
+
+std::future<void> AsyncDriver::submitv(const std::vector<shift_segment> &segs) {
+
+   auto p = std::make_shared<std::promise<void>>();
+   std::future<void> f = p->get_future();
+
+   enqueue({ segs, [p](std::exception_ptr e) {
+      if(e)
+         p->set_exception(e);
+      else
+         p->set_value();
+   }});
+
+   return f;
+}
+
+void AsyncDriver::submitv(const std::vector<shift_segment> &segs, shift_callback cb) {
+
+   enqueue({ segs, [cb](std::exception_ptr e) { cb(e == nullptr); } });
+}
+
+std::future<void> AsyncDriver::submit(int nbits, unsigned char *buffer, unsigned char *result) {
+
+   return submitv({{ nbits, buffer, buffer + (nbits + 7) / 8, result }});
+}
+
+void AsyncDriver::submit(int nbits, unsigned char *buffer, unsigned char *result, shift_callback cb) {
+
+   submitv({{ nbits, buffer, buffer + (nbits + 7) / 8, result }}, cb);
+}
+
+// wait completion of every queued operation
+void AsyncDriver::drain(void) {
+
+   std::unique_lock<std::mutex> guard(lock);
+   idleCond.wait(guard, [&]{ return pending == 0; });
+}
+
+int AsyncDriver::getPending(void) {
+
+   std::lock_guard<std::mutex> guard(lock);
+   return pending;
+}
+
+void AsyncDriver::run(void) {
+
+   std::deque<async_job> batch;
+   std::vector<shift_segment> segs;
+
+   while(true) {
+
+      {
+         std::unique_lock<std::mutex> guard(lock);
+         queueCond.wait(guard, [&]{ return stop || !queue.empty(); });
+
+         if(queue.empty())
+            return;
+
+         batch.swap(queue);
+      }
+
+      // every queued operation runs in the same driver transaction
+      segs.clear();
+      for(unsigned int i=0; i<batch.size(); i++)
+         segs.insert(segs.end(), batch[i].segs.begin(), batch[i].segs.end());
+
+      printDebug("AsyncDriver: " + std::to_string(batch.size()) + " operations, " + std::to_string(segs.size()) + " segments", 2);
+
+      std::exception_ptr error = nullptr;
+      try {
+         ClientLock guard(drv);
+         drv->shiftv(segs);
+      } catch (const std::exception &e) {
+         std::cout << "E: AsyncDriver: " << e.what() << std::endl;
+         error = std::current_exception();
+      }
+
+      for(unsigned int i=0; i<segs.size(); i++)
+         trackTMS(segs[i].nbits, segs[i].tms, segs[i].tdi);
+
+      jobs += batch.size();
+      transactions++;
+
+      // callbacks may queue further operations
+      for(unsigned int i=0; i<batch.size(); i++)
+         batch[i].done(error);
+
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         pending -= batch.size();
+      }
+      idleCond.notify_all();
+
+      batch.clear();
+   }
+}
@@ -1,7 +1,10 @@
 #include "axicalibrator.h"
+#include "bitvector.h"
 #include <ctime>
+#include <chrono>
+#include <algorithm>
 
-AXICalibrator::AXICalibrator(AXIDevice *d) {
+AXICalibrator::AXICalibrator(AXIDevice *d) : engine(d) {
    dev = d;
 }
 
@@ -10,6 +13,346 @@ void AXICalibrator::printDebug(std::string msg, int lvl) {
       std::cout << msg << std::endl;
 }
 
+// capture delay only moves TDO sampling, TAP stays in BYPASS unless a probe fails
+bool AXICalibrator::probe(int cdel) {
+
+   std::vector<uint32_t> words(PROBE_WORDS);
+
+   for(int i=0; i<PROBE_WORDS; i++)
+      words[i] = std::rand();
+
+   dev->setClockDelay(cdel);
+   probes++;
+
+   return engine.probeWords(words);
+}
+
+// window from minDelay and maxDelay found as the exhaustive sweep does: first run of hyst
+// consecutive valid delays (starting hyst points before) up to the first failure
+void AXICalibrator::setEye(axi_eye &eye, int first, int last) {
+
+   int run = (hyst > 0) ? hyst : 1;
+
+   eye.minDelay = first + run - 1 - hyst;
+   eye.maxDelay = last;
+   eye.validPoints = last - eye.minDelay + 1;
+}
+
+// every delay from cdiv/2 probed until the valid window is left
+bool AXICalibrator::sweepEye(int cdiv, axi_eye &eye) {
+
+   int cfreq = 100000000 / ((cdiv + 1) * 2);
+   int first = -1, last = -1;
+   int h = 0;
+
+   for(int cdel=cdiv/2; cdel<MAX_CLOCK_DELAY; cdel++) {
+
+      if(probe(cdel)) {
+
+         if(first == -1 && ++h >= hyst) {
+            if(debugLevel) {
+               char msg[128];
+               sprintf(msg, "AXICalibrator::startCalibration: idcode OK - clkdelay: %d - clkdiv: %d - clkfreq: %d", cdel, cdiv, cfreq);
+               printDebug(msg, 2);
+            }
+            first = cdel - ((hyst > 0) ? hyst : 1) + 1;
+         }
+
+         if(first != -1)
+            last = cdel;
+
+      } else {
+
+         h = 0;
+
+         char msg[128];
+         sprintf(msg, "AXICalibrator::startCalibration: idcode FAIL - clkdelay: %d - clkdiv: %d - clkfreq: %d", cdel, cdiv, cfreq);
+         printDebug(msg, 2);
+
+         if(first != -1)  // idcode not valid after a set of valid results...
+            break;
+      }
+   }
+
+   if(first == -1)
+      return false;
+
+   setEye(eye, first, last);
+   return true;
+}
+
+// last valid delay going from valid delay pass towards limit, the edge is looked for
+// around guess first: valid delays are assumed to be contiguous
+int AXICalibrator::searchEdge(int pass, int limit, int guess) {
+
+   int dir = (limit > pass) ? 1 : -1;
+   int good = pass, bad, step = 1;
+
+   if(pass == limit)
+      return pass;
+
+   if((guess - pass) * dir <= 0 || (guess - limit) * dir > 0)
+      guess = pass + dir;
+
+   if(probe(guess)) {
+
+      // gallop outwards from a valid guess
+      good = guess;
+      while(true) {
+         if(good == limit)
+            return good;
+         int x = good + dir * step;
+         if((x - limit) * dir > 0)
+            x = limit;
+         if(!probe(x)) {
+            bad = x;
+            break;
+         }
+         good = x;
+         step *= 2;
+      }
+
+   } else {
+
+      // gallop inwards from a failing guess
+      bad = guess;
+      while(true) {
+         int x = bad - dir * step;
+         if((x - pass) * dir <= 0)
+            break;
+         if(probe(x)) {
+            good = x;
+            break;
+         }
+         bad = x;
+         step *= 2;
+      }
+   }
+
+   // bisection between good and bad
+   while((bad - good) * dir > 1) {
+      int mid = (good + bad) / 2;
+      if(probe(mid))
+         good = mid;
+      else
+         bad = mid;
+   }
+
+   return good;
+}
+
+// binary search of the window edges starting from the previous window scaled by period
+bool AXICalibrator::searchEye(int cdiv, axi_eye *prev, int prevDiv, axi_eye &eye) {
+
+   int lo = cdiv / 2, hi = MAX_CLOCK_DELAY - 1;
+   int pass = -1;
+   int guessFirst = -1, guessLast = -1;
+
+   if(prev) {
+      float scale = float(cdiv + 1) / (prevDiv + 1);
+      int first = prev->maxDelay - prev->validPoints + 1;
+      guessFirst = first * scale;
+      guessLast = prev->maxDelay * scale;
+      int center = (guessFirst + guessLast) / 2;
+      if(center >= lo && center <= hi && probe(center))
+         pass = center;
+   }
+
+   // coarse scan, step is the narrowest accepted window
+   int step = (cdiv / 2 > 1) ? cdiv / 2 : 1;
+   for(int cdel=lo; pass == -1 && cdel<=hi; cdel+=step)
+      if(probe(cdel))
+         pass = cdel;
+
+   if(pass == -1)
+      return false;
+
+   int first = searchEdge(pass, lo, guessFirst);
+   int last = searchEdge(pass, hi, guessLast);
+
+   if(last - first + 1 < ((hyst > 0) ? hyst : 1))
+      return false;
+
+   if(debugLevel) {
+      char msg[128];
+      sprintf(msg, "AXICalibrator::searchEye: window %d-%d - clkdiv: %d - probes: %ld", first, last, cdiv, probes);
+      printDebug(msg, 2);
+   }
+
+   setEye(eye, first, last);
+   return true;
+}
+
+// window at the slowest clock, where every cable and target leave a valid delay
+bool AXICalibrator::slowestEye(axi_eye &eye) {
+
+   dev->setClockDiv(MAX_CLOCK_DIV);
+   engine.invalidate();
+
+   return searchEye(MAX_CLOCK_DIV, nullptr, 0, eye);
+}
+
+// first valid capture delay at the slowest clock, it follows the cable round-trip delay
+int AXICalibrator::measureRoundTrip(void) {
+
+   axi_eye eye;
+
+   if(!slowestEye(eye))
+      return -1;
+
+   return eye.minDelay;
+}
+
+bool AXICalibrator::setSafeClock(void) {
+
+   axi_eye eye;
+
+   if(!slowestEye(eye))
+      return false;
+
+   dev->setClockDelay((eye.minDelay + eye.maxDelay) / 2);
+   engine.invalidate();
+
+   return true;
+}
+
+bool AXICalibrator::trackEye(int cdiv, int cdel, axi_eye &eye) {
+
+   if(dev->getClockDiv() != cdiv) {
+      dev->setClockDiv(cdiv);
+      engine.invalidate();
+   }
+
+   if(!probe(cdel))
+      return searchEye(cdiv, nullptr, 0, eye);
+
+   int first = searchEdge(cdel, std::min(cdel, cdiv / 2), eye.minDelay);
+   int last = searchEdge(cdel, MAX_CLOCK_DELAY - 1, eye.maxDelay);
+
+   if(debugLevel) {
+      char msg[128];
+      sprintf(msg, "AXICalibrator::trackEye: window %d-%d - clkdiv: %d - probes: %ld", first, last, cdiv, probes);
+      printDebug(msg, 2);
+   }
+
+   eye.minDelay = first;
+   eye.maxDelay = last;
+   eye.validPoints = last - first + 1;
+   return true;
+}
+
+// TDO is launched half a TCK period (cdiv + 1 cycles) after the capture delay reference
+// and stays valid for a period: the window starts roundTrip cycles later
+bool AXICalibrator::measureCable(void) {
+
+   axi_eye eye;
+
+   // window cut by the delay range gives no period information
+   if(!slowestEye(eye) || eye.maxDelay >= MAX_CLOCK_DELAY - 1)
+      return false;
+
+   roundTrip = eye.minDelay - (MAX_CLOCK_DIV + 1);
+   windowLoss = std::max(2 * (MAX_CLOCK_DIV + 1) - eye.validPoints, 0);
+
+   printf("I: round-trip delay: %d cycles, window loss: %d cycles (window %d-%d at clock divisor %d)\n",
+      roundTrip, windowLoss, eye.minDelay, eye.maxDelay, MAX_CLOCK_DIV);
+
+   return true;
+}
+
+// window of the cable model checked with a probe on both sides of each edge, so a
+// verified window is measured as the sweep would; the edges are searched around the
+// predicted ones where the model does not hold
+bool AXICalibrator::predictEye(int cdiv, axi_eye &eye) {
+
+   int first = roundTrip + cdiv + 1;
+   int last = std::min(first + 2 * (cdiv + 1) - 1 - windowLoss, MAX_CLOCK_DELAY - 1);
+
+   // delays are probed from cdiv/2 as the sweep does
+   first = std::max(first, cdiv / 2);
+
+   // edges at the ends of the probed range have no failing side
+   if(last - first + 1 >= ((hyst > 0) ? hyst : 1) && probe(first) && probe(last) &&
+      (first == cdiv / 2 || !probe(first - 1)) &&
+      (last == MAX_CLOCK_DELAY - 1 || !probe(last + 1))) {
+      setEye(eye, first, last);
+      return true;
+   }
+
+   axi_eye guess = {first, last, last - first + 1};
+
+   printDebug("AXICalibrator::predictEye: window " + std::to_string(first) + "-" + std::to_string(last) +
+      " not verified - clkdiv: " + std::to_string(cdiv), 2);
+
+   if(!searchEye(cdiv, (last >= first) ? &guess : nullptr, cdiv, eye))
+      return false;
+
+   // next divisors are predicted from the nearest measured window
+   roundTrip = eye.minDelay - (cdiv + 1);
+   windowLoss = std::max(2 * (cdiv + 1) - eye.validPoints, 0);
+
+   return true;
+}
+
+// each row keeps BYPASS loaded and only moves the capture delay between cells; rows
+// start at cdiv/2 as the calibration does and end EYE_TAIL cells past the window
+void AXICalibrator::captureEyeMap(EyeMap *map, int divStep, uint64_t bits) {
+
+   printDebug("AXICalibrator::captureEyeMap start", 1);
+
+   bool found = false;
+   uint64_t cells = 0;
+   auto t0 = std::chrono::steady_clock::now();
+
+   map->clear();
+   std::cout << "I: eye map capture started" << std::endl;
+
+   for(int cdiv=0; cdiv<=MAX_CLOCK_DIV; cdiv+=divStep) {
+
+      printf("\r %d%%", int(float(cdiv) / MAX_CLOCK_DIV * 100));
+      fflush(stdout);
+
+      eye_row row;
+      bool clean = false;
+      int tail = 0;
+
+      row.cdiv = cdiv;
+      row.firstDelay = cdiv / 2;
+      dev->setClockDiv(cdiv);
+
+      BERTester ber(dev, verbose, debugLevel);
+      ber.setPattern(berOrder);
+      ber.setVectorBits(EYE_VECTOR_BITS);
+      ber.setGate(gate);
+
+      for(int cdel=row.firstDelay; cdel<MAX_CLOCK_DELAY; cdel++) {
+
+         dev->setClockDelay(cdel);
+         ber_result r = ber.run(bits, EYE_MAX_ERRORS);
+         row.cells.push_back({(uint32_t) r.bits, (uint32_t) r.errors});
+
+         if(r.errors == 0) {
+            clean = true;
+            tail = 0;
+         } else if(clean && ++tail >= EYE_TAIL)
+            break;
+      }
+
+      cells += row.cells.size();
+      map->addRow(row);
+
+      // no window at lower frequency once windows have been found
+      if(found && !clean)
+         break;
+      found |= clean;
+   }
+
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   printf("\nI: eye map: %d rows, %lu cells in %.2f s\n", map->getRows(), (unsigned long) cells, elapsed);
+
+   printDebug("AXICalibrator::captureEyeMap end", 1);
+}
+
 void AXICalibrator::start(AXISetup *setup, unsigned int calibSize) {
 
    printDebug("AXICalibrator::start start", 1);
@@ -19,20 +362,43 @@ void AXICalibrator::start(AXISetup *setup, unsigned int calibSize) {
 
    std::cout << "I: calibration started" << std::endl;
 
+   // read at the clock setup calibration starts from, before any probe
+   double celsius;
+   if(sensor && sensor->read(celsius)) {
+      char temp[16];
+      sprintf(temp, "%.1f", celsius);
+      setup->setMeta("temperature", temp);
+      std::cout << "I: die temperature " << temp << " C" << std::endl;
+   }
+
    int id = 0;       // calibration id
    int cdiv = 0;     // clock divisor
-   int cdel = 0;     // clock delay
    int cfreq;        // clock frequency
-   int validPoints;  // consecutive valid measurements
 
-   int minDelay, maxDelay;
    int currIter = 0;
    int interval = 5;
-   int h = 0;
-   bool record = false;
    unsigned int numEntry = 0;
 
+   axi_eye eye, last;
+   int lastDiv = -1;
+   long sweepProbes = 0;
+
    std::srand(std::time(NULL));
+   probes = 0;
+   auto t0 = std::chrono::steady_clock::now();
+
+   // search is used when the slowest clock gives no cable model
+   int calibMode = mode;
+   if(calibMode == CALIB_PREDICT) {
+      if(measureCable()) {
+         // cable fingerprint as the calibration cache records it
+         setup->setMeta("rtt", std::to_string(roundTrip + MAX_CLOCK_DIV + 1));
+         setup->setMeta("windowloss", std::to_string(windowLoss));
+      } else {
+         std::cout << "I: no complete window at slowest clock - window search used" << std::endl;
+         calibMode = CALIB_SEARCH;
+      }
+   }
 
    // phase 1 : detect working frequency writing/reading a random value in bypass mode
 
@@ -46,105 +412,93 @@ void AXICalibrator::start(AXISetup *setup, unsigned int calibSize) {
       }
 
       dev->setClockDiv(cdiv);
-
-      minDelay = -1;
-      maxDelay = -1;
-      validPoints = 0;
-      record = false;
+      engine.invalidate();
       cfreq = 100000000 / ((cdiv + 1) * 2);
-      h = 0;
-
-      for(cdel=cdiv/2; cdel<MAX_CLOCK_DELAY; cdel++) {
-
-         dev->setClockDelay(cdel);
-
-         uint32_t probeValue = std::rand();
 
-         if(dev->probeBypass(probeValue) == probeValue) {
+      bool found;
+      if(calibMode == CALIB_PREDICT)
+         found = predictEye(cdiv, eye);
+      else if(calibMode == CALIB_SEARCH)
+         found = searchEye(cdiv, (lastDiv >= 0) ? &last : nullptr, lastDiv, eye);
+      else
+         found = sweepEye(cdiv, eye);
+
+      // probes the sweep would have needed, for the runtime report
+      if(found)
+         sweepProbes += std::min(eye.maxDelay + 2, MAX_CLOCK_DELAY) - cdiv/2;
+      else
+         sweepProbes += MAX_CLOCK_DELAY - cdiv/2;
+
+      if(!found) {
+         // no window at lower frequency once windows have been found
+         if(calibMode != CALIB_SWEEP && lastDiv >= 0) {
+            for(int d=cdiv+1; d<=MAX_CLOCK_DIV; d++)
+               sweepProbes += MAX_CLOCK_DELAY - d/2;
+            printf("\nI: no valid window at clock divisor %d - calibration search stopped\n", cdiv);
+            break;
+         }
+         continue;
+      }
 
-            if(minDelay == -1) {
+      last = eye;
+      lastDiv = cdiv;
 
-               if(++h >= hyst) {
-                  if(debugLevel) {
-                     char msg[128];
-                     sprintf(msg, "AXICalibrator::startCalibration: idcode OK - clkdelay: %d - clkdiv: %d - clkfreq: %d", cdel, cdiv, cfreq);
-                     printDebug(msg, 2);
-                  }
-                  validPoints = hyst;
-                  minDelay = cdel-hyst;
-                  record = true;
-               }
-            }
-
-            if(record) {
-               maxDelay = cdel;
-               validPoints++;
-            }
+      // check if valid is greater then divisor/2
+      if (eye.validPoints >= cdiv/2) {
 
-         } else {    // dev->probeBypass(probeValue) != probeValue
+         AXICalibItem item;
+         item.setId(id++);
+         item.setClockDivisor(cdiv);
+         item.setClockDelay((eye.maxDelay + eye.minDelay) / 2);
+         item.setClockFrequency(cfreq);
+         item.setValidPoints(eye.validPoints);
+         item.setEyeWidth((eye.validPoints / float((cdiv + 1) * 2)) * 100);
 
-            h = 0;
-            
-            char msg[128];
-            sprintf(msg, "AXICalibrator::startCalibration: idcode FAIL - clkdelay: %d - clkdiv: %d - clkfreq: %d", cdel, cdiv, cfreq);
+         if(debugLevel) {
+            char msg[256];
+            sprintf(msg, "AXICalibrator::startCalibration: idcode OK - clkdelay: %d - clkdiv: %d - clkfreq: %d - points: %d - eyewidth: %d",
+               item.getClockDelay(), item.getClockDivisor(), item.getClockFrequency(), item.getValidPoints(), item.getEyeWidth());
             printDebug(msg, 2);
-            
-            if(record)  // idcode not valid after a set of valid results...
-               break;
          }
 
-      }  // end for loop (clock delay)
-
-      if(record) {    // we found a valid clkdelay/clkdiv combination...
-
-         // check if valid is greater then divisor/2
-         if (validPoints >= cdiv/2) {
-
-            AXICalibItem item;
-            item.setId(id++);
-            item.setClockDivisor(cdiv);
-            item.setClockDelay((maxDelay + minDelay) / 2);
-            item.setClockFrequency(cfreq);
-            item.setValidPoints(validPoints);
-            item.setEyeWidth((validPoints / float((cdiv + 1) * 2)) * 100);
-
-            if(debugLevel) {
-               char msg[256];
-               sprintf(msg, "AXICalibrator::startCalibration: idcode OK - clkdelay: %d - clkdiv: %d - clkfreq: %d - points: %d - eyewidth: %d",
-                  item.getClockDelay(), item.getClockDivisor(), item.getClockFrequency(), item.getValidPoints(), item.getEyeWidth());
-               printDebug(msg, 2);
-            }
+         setup->addItem(item);
 
-            setup->addItem(item);
-
-            if(calibSize && ++numEntry == calibSize) {
-               printf("\nI: quick mode enabled - calibration stopped after %d valid measurements\n", calibSize);
-               goto phase2; 
-            }
-               
+         if(calibSize && ++numEntry == calibSize) {
+            printf("\nI: quick mode enabled - calibration stopped after %d valid measurements\n", calibSize);
+            break;
          }
-
-      } 
+            
+      }
 
    } // end for loop (clock divisor)
 
-   // phase 2 : hardening test on high frequency with some bits patterns
+   {
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      if(calibMode != CALIB_SWEEP)
+         printf("\nI: window %s: %ld probes in %.2f s, exhaustive sweep: ~%ld probes (%.1fx)\n",
+            (calibMode == CALIB_PREDICT) ? "prediction" : "search", probes, elapsed, sweepProbes, probes ? float(sweepProbes) / probes : 0);
+      else
+         printf("\nI: window sweep: %ld probes in %.2f s\n", probes, elapsed);
+   }
 
-phase2:
+   // phase 2 : hardening test on high frequency with some bits patterns
 
    int nsample = 32;
    int npass = 100;
    const uint32_t ones = 0x80000000;
-   std::vector<uint32_t> rdbuf;
    std::vector<int> badList;
    bool goodItem;
 
-   // build test data buffers
-   std::vector<uint32_t> wzbuf, gzbuf, wobuf;
-   for(int i=0; i<nsample; i++) {
-      wzbuf.push_back(~(ones >> i));
-      gzbuf.push_back(~ones >> i);
-      wobuf.push_back(ones >> i);
+   // every pass of the three patterns streamed in a single vector
+   int nbits = 3 * npass * 32 * nsample;
+   std::vector<unsigned char> hardening(nbits / 8);
+   for(int pass=0; pass<npass; pass++) {
+      for(int i=0; i<nsample; i++) {
+         int pos = 3 * pass * 32 * nsample;
+         bitPut(hardening.data(), pos + 32*i, ~(ones >> i), 32);                       // walking zero
+         bitPut(hardening.data(), pos + 32*(nsample + i), ~ones >> i, 32);             // growing zero
+         bitPut(hardening.data(), pos + 32*(2*nsample + i), ones >> i, 32);            // walking one
+      }
    }
 
    badList.clear();
@@ -159,45 +513,29 @@ phase2:
       // apply config to FPGA
       dev->setClockDiv(item->getClockDivisor());       
       dev->setClockDelay(item->getClockDelay());       
+      engine.invalidate();
 
-      //printf("start walking zero test\n");
-      for(int i=0,pass=0; (goodItem && pass<npass); i++, pass++) {
-         rdbuf = dev->probeBypass(wzbuf);
-         if (rdbuf != wzbuf) {
-            /*
-            printf("pass: %d , freq = %d cdiv/cdel = %d/%d walking zero test failure \n", \
-               pass, item->getClockFrequency(), item->getClockDivisor(), item->getClockDelay()); 
-            */
-            badList.push_back(item->getId());
-            goodItem = false;
-         }
-      } 
-
-      //printf("start growing zero test\n");
-      for(int i=0,pass=0; (goodItem && pass<npass); i++, pass++) {
-         rdbuf = dev->probeBypass(gzbuf);
-         if (rdbuf != gzbuf) {
-            /*
-            printf("pass: %d , freq = %d cdiv/cdel = %d/%d growing zero test failure \n", \
-               pass, item->getClockFrequency(), item->getClockDivisor(), item->getClockDelay()); 
-            */
-            badList.push_back(item->getId());
-            goodItem = false;
+      if (engine.probeBits(hardening.data(), nbits) != 0) {
+         if(debugLevel) {
+            char msg[128];
+            sprintf(msg, "AXICalibrator::start: pattern test failure - freq = %d cdiv/cdel = %d/%d",
+               item->getClockFrequency(), item->getClockDivisor(), item->getClockDelay());
+            printDebug(msg, 2);
          }
-      } 
-
-      //printf("start walking one test\n");
-      for(int i=0,pass=0; (goodItem && pass<npass); i++, pass++) {
-         rdbuf = dev->probeBypass(wobuf);
-         if (rdbuf != wobuf) {
-            /*
-            printf("pass: %d , freq = %d cdiv/cdel = %d/%d walking one test failure \n", \
-               pass, item->getClockFrequency(), item->getClockDivisor(), item->getClockDelay()); 
-            */
+         badList.push_back(item->getId());
+         goodItem = false;
+      }
+
+      // PRBS test on a long sequence, stops at first error
+      if(goodItem && berBits > 0) {
+         BERTester ber(dev, verbose, debugLevel);
+         ber.setPattern(berOrder);
+         ber.setGate(gate);
+         if(ber.run(berBits, 1).errors) {
             badList.push_back(item->getId());
             goodItem = false;
          }
-      } 
+      }
 
    }
 
@@ -206,6 +544,9 @@ phase2:
 
    setup->finalize();
 
+   if(verbose)
+      printf("\nAXICalibrator: %ld probe shifts, %ld BYPASS navigations\n", engine.getShifts(), engine.getNavigations());
+
    printDebug("AXICalibrator::start end", 1);
    std::cout << "\nI: calibration finished" << std::endl;
 }
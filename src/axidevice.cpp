@@ -1,12 +1,12 @@
 #include "axidevice.h"
+#include "bitvector.h"
 
-AXIDevice::AXIDevice(bool v, int dl) {
+AXIDevice::AXIDevice(bool v, int dl, const char *uio) {
     
    setName("AXI");
    verbose = v;
    debugLevel = dl;
-   const char *uioid = getenv("AXIJTAG_UIO_ID");
-   std::string uiodev;   
+   const char *uioid = (uio != nullptr) ? uio : getenv("AXIJTAG_UIO_ID");
 
    if(uioid != NULL)
       uiodev = "/dev/uio" + std::string(uioid);
@@ -40,12 +40,27 @@ bool AXIDevice::detect(void) {
    const char *tempDesc;
    bool found = false;
 
-   // read id code at low clock frequency with delay sweep
+   // read id code at low clock frequency with delay sweep: a short probe after reset
+   // rejects delays without valid TDO, the whole chain is scanned at the centre of the
+   // first run of delays reading the same code, away from the edges of the window
    setClockDiv(MAX_CLOCK_DIV);
 
-   for(int cdel=0; cdel<MAX_CLOCK_DELAY; cdel++) {
+   for(int cdel=0; cdel<MAX_CLOCK_DELAY && !found; cdel++) {
 
       setClockDelay(cdel);
+      tempId = probeResetCode();
+      if(tempId == 0 || tempId == 0xFFFFFFFF)
+         continue;
+
+      int last = cdel;
+      while(last + 1 < MAX_CLOCK_DELAY) {
+         setClockDelay(last + 1);
+         if(probeResetCode() != tempId)
+            break;
+         last++;
+      }
+
+      setClockDelay((cdel + last) / 2);
       tempId = scanChain();
       tempDesc = devDB.idToDescription(tempId);
 
@@ -58,6 +73,8 @@ bool AXIDevice::detect(void) {
 
          detected = true;
       }
+
+      cdel = last;
    }
 
    if(detected && verbose)
@@ -91,9 +108,8 @@ void AXIDevice::shift(int nbits, unsigned char *buffer, unsigned char *result) {
    
    int nbytes = (nbits + 7) / 8;
 
-   int bytesLeft = nbytes;
    int bitsLeft = nbits;
-   unsigned int *tdi, *tms, *tdo; 
+   int pos = 0;
    unsigned int tmsVal, tdiVal, tdoVal;
    unsigned int last_tdi, last_tms; 
    
@@ -101,35 +117,32 @@ void AXIDevice::shift(int nbits, unsigned char *buffer, unsigned char *result) {
    last_tdi = ptr->tdi_offset = 0;
    ptr->length_offset = 32;
    
-   tms = reinterpret_cast<unsigned int*>(buffer);
-   tdi = reinterpret_cast<unsigned int*>(buffer+nbytes);
-   tdo = reinterpret_cast<unsigned int*>(result);
+   trackTMS(nbits, buffer, buffer + (nbits + 7) / 8);
+
+   // unused bits of last TDO byte are cleared
+   if (nbytes)
+      result[nbytes - 1] = 0;
 
    while (bitsLeft > 0) {
 
-      if (bitsLeft < 32) {
-         
-         ptr->length_offset = bitsLeft;
-   
-         tmsVal = tdiVal = 0;
-         memcpy(&tmsVal, tms, bytesLeft);
-         memcpy(&tdiVal, tdi, bytesLeft);
+      int len = (bitsLeft < 32) ? bitsLeft : 32;
 
-         tms = &tmsVal;
-         tdi = &tdiVal;
+      if (len < 32)
+         ptr->length_offset = len;
 
-      }
+      tmsVal = bitGet(buffer, pos, len);
+      tdiVal = bitGet(buffer + nbytes, pos, len);
 
-      if (*tms != last_tms)
+      if (tmsVal != last_tms)
       {
-         ptr->tms_offset = *tms;
-         last_tms = *tms;
+         ptr->tms_offset = tmsVal;
+         last_tms = tmsVal;
       }
 
-      if (*tdi != last_tdi)
+      if (tdiVal != last_tdi)
       {
-         ptr->tdi_offset = *tdi;
-         last_tdi = *tdi;
+         ptr->tdi_offset = tdiVal;
+         last_tdi = tdiVal;
       }
 
       ptr->ctrl_offset = 0x01;
@@ -138,29 +151,20 @@ void AXIDevice::shift(int nbits, unsigned char *buffer, unsigned char *result) {
 
       tdoVal = ptr->tdo_offset;
            
-      if (bitsLeft < 32) {
-      
-        // aligns captured TDO vector to lsb, compensates lack of hardware shifts 
-        tdoVal = tdoVal >> (32 - bitsLeft);
-        memcpy(tdo, &tdoVal, bytesLeft);
+      // aligns captured TDO vector to lsb, compensates lack of hardware shifts 
+      if (len < 32)
+         tdoVal = tdoVal >> (32 - len);
 
-      } else {
-
-        tdo[0] = tdoVal;
-        
-      }
+      bitPut(result, pos, tdoVal, len);
 
       if(debugLevel) {
          char msg[128];
-         sprintf(msg, "Bytes:%d Bits:%d TMS:0x%08x TDI:0x%08x TDO:0x%08x", (bytesLeft>4)?4:bytesLeft, (bitsLeft>32)?32:bitsLeft, *tms, *tdi, tdoVal);
+         sprintf(msg, "Bytes:%d Bits:%d TMS:0x%08x TDI:0x%08x TDO:0x%08x", (len + 7) / 8, len, tmsVal, tdiVal, tdoVal);
          printDebug(msg, 3);
       }     
 
-      bytesLeft -= 4;
       bitsLeft -= 32;
-      tms++; // tms, tdi and tdo  pointers are not valid when bitsLeft < 32
-      tdi++; // but then the are not used anymore
-      tdo++;
+      pos += 32;
 
    } // end while
 }
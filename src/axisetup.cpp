@@ -44,6 +44,7 @@ bool AXISetup::loadFile(std::string filename) {
    if(fp) {
 
       clear();
+      meta.clear();
       while(!feof(fp)) {
 
          int i;
@@ -53,9 +54,15 @@ bool AXISetup::loadFile(std::string filename) {
          while (i > 0 && isspace(buffer[i-1]))
             i--;
          buffer[i] = 0;
-         if(buffer[0] == '#')
+         if(buffer[0] == '#') {
+            char *eq = strchr(buffer, '=');
+            if(eq && !strchr(buffer, ' ')) {
+               *eq = 0;
+               meta[buffer + 1] = eq + 1;
+            }
             continue;
-         if (sscanf(buffer,"%64s %64s %64s %64s %64s %64s", 
+         }
+         if (sscanf(buffer,"%63s %63s %63s %63s %63s %63s", 
                      id, clkDiv, clkDelay, clkFreq, validPoints, eyeWidth) == 6) {
 
             AXICalibItem item;
@@ -81,6 +88,10 @@ bool AXISetup::saveFile(std::string filename) {
    fp = fopen(filename.c_str(),"wt");
    if(fp) {
 
+      std::map<std::string, std::string>::iterator m;
+      for(m=meta.begin(); m!=meta.end(); m++)
+         fprintf(fp, "#%s=%s\n", m->first.c_str(), m->second.c_str());
+
       fprintf(fp, "%-10s%10s%10s%10s%10s%10s\n", "#id", "divisor", "delay", "frequency", "valid", "eyewidth");
 
       std::vector<AXICalibItem>::iterator it;
@@ -0,0 +1,112 @@
+#include "backgroundcalibrator.h"
+#include "bertester.h"
+
+BackgroundCalibrator::BackgroundCalibrator(XVCDriver *d, bool v, int dl) : gate(d) {
+
+   dev = d;
+   verbose = v;
+   debugLevel = dl;
+}
+
+BackgroundCalibrator::~BackgroundCalibrator() {
+
+   if(worker.joinable())
+      worker.join();
+}
+
+void BackgroundCalibrator::printDebug(std::string msg, int lvl) {
+   if (debugLevel >= lvl)
+      std::cout << msg << std::endl;
+}
+
+void BackgroundCalibrator::apply(AXICalibItem *item) {
+
+   AXIDevice *adev = (AXIDevice *) dev;
+   adev->setClockDiv(item->getClockDivisor());
+   adev->setClockDelay(item->getClockDelay());
+}
+
+void BackgroundCalibrator::apply(FTDICalibItem *item) {
+
+   FTDIDevice *fdev = (FTDIDevice *) dev;
+   fdev->setClockDiv(item->getClockDiv5(), item->getClockDivisor());
+   fdev->setTDOPosSampling((bool)item->getTDOSampling());
+}
+
+// candidate points from the fastest one until a point passes the PRBS check, clients
+// run at it once the gate is left
+template <typename S> bool BackgroundCalibrator::select(S *setup) {
+
+   while(setup->getListSize() > 0) {
+
+      auto *item = (freq != -1) ? setup->getItemByFrequency(freq) : setup->getItemByMaxFrequency();
+      apply(item);
+
+      BERTester ber(dev, verbose, debugLevel);
+      ber.setGate(&gate);
+      if(ber.run(BG_CHECK_BITS, 1).errors == 0) {
+         gate.setClientClock(dev->getClockSetting());
+         std::cout << "I: background calibration: switched to setup id " << item->getId() <<
+            " (" << item->getClockFrequency() << " Hz)" << std::endl;
+         return true;
+      }
+
+      printDebug("BackgroundCalibrator::select setup id " + std::to_string(item->getId()) + " failed validation", 1);
+      setup->delItemById(item->getId());
+   }
+
+   std::cout << "E: background calibration: no valid calibration setting found, safe clock kept" << std::endl;
+   return false;
+}
+
+void BackgroundCalibrator::setTask(AXICalibrator *calib, AXISetup *setup, unsigned int calibSize) {
+
+   task = [this, calib, setup, calibSize]() {
+
+      gate.enter();
+      calib->setGate(&gate);
+      calib->start(setup, calibSize);
+      calib->setGate(nullptr);
+      bool found = select(setup);
+      gate.leave();
+
+      if(found && cache && cache->save(setup))
+         std::cout << "I: calibration data saved in cache " << cache->getFilename() << std::endl;
+   };
+}
+
+void BackgroundCalibrator::setTask(FTDICalibrator *calib, FTDISetup *setup, int minFreq, int maxFreq, int loop) {
+
+   task = [this, calib, setup, minFreq, maxFreq, loop]() {
+
+      gate.enter();
+      calib->setGate(&gate);
+      calib->start(setup, minFreq, maxFreq, loop);
+      calib->setGate(nullptr);
+      bool found = select(setup);
+      gate.leave();
+
+      if(found && cache && cache->save(setup))
+         std::cout << "I: calibration data saved in cache " << cache->getFilename() << std::endl;
+   };
+}
+
+void BackgroundCalibrator::start(void) {
+
+   if(!task)
+      return;
+
+   // clients keep the clock setup found at start until a point is validated
+   gate.setClientClock(dev->getClockSetting());
+
+   worker = std::thread([this]() {
+
+      auto t0 = std::chrono::steady_clock::now();
+
+      task();
+
+      double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      std::cout << "I: background calibration finished in " << sec << " s, " << gate.getYields() << " yields to clients" << std::endl;
+      done = true;
+   });
+}
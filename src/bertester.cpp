@@ -0,0 +1,112 @@
+#include "bertester.h"
+#include "bitvector.h"
+#include <chrono>
+#include <cmath>
+
+PRBSGenerator::PRBSGenerator(int o) {
+
+   if(!setOrder(o))
+      setOrder(31);
+}
+
+bool PRBSGenerator::setOrder(int o) {
+
+   switch(o) {
+      case 7: tap = 6; break;
+      case 15: tap = 14; break;
+      case 31: tap = 28; break;
+      default: return false;
+   }
+
+   // sequence starts from all ones state
+   order = o;
+   work.assign((order + 7) / 8, 0);
+   bitFill(work.data(), 0, order, 1);
+
+   return true;
+}
+
+// b[i] = b[i - order] ^ b[i - tap], runs of tap bits are computed at once from the
+// previous bits; work holds the last order bits followed by the new ones
+void PRBSGenerator::generate(unsigned char *dst, int nbits) {
+
+   if(nbits <= 0)
+      return;
+
+   work.resize((order + nbits + 7) / 8);
+
+   for(int i=order; i<order+nbits; i+=tap) {
+      int n = (order + nbits - i < tap) ? order + nbits - i : tap;
+      bitPut(work.data(), i, bitGet(work.data(), i - order, n) ^ bitGet(work.data(), i - tap, n), n);
+   }
+
+   bitCopy(dst, 0, work.data(), order, nbits);
+   bitCopy(work.data(), 0, work.data(), nbits, order);
+}
+
+BERTester::BERTester(XVCDriver *d, bool v, int dl) : engine(d) {
+
+   verbose = v;
+   debugLevel = dl;
+}
+
+void BERTester::printDebug(std::string msg, int lvl) {
+   if (debugLevel >= lvl)
+      std::cout << msg << std::endl;
+}
+
+// chi-square quantile with k degrees of freedom (Wilson-Hilferty), z is the normal quantile
+static double chiSquare(double k, double z) {
+
+   double a = 2.0 / (9.0 * k);
+   double c = 1.0 - a + z * sqrt(a);
+
+   return (c > 0) ? k * c * c * c : 0;
+}
+
+ber_result BERTester::run(uint64_t nbits, uint64_t maxErrors) {
+
+   printDebug("BERTester::run start", 1);
+
+   ber_result r = {0, 0, 0, 0, 0, 0, 0};
+   tx.resize((vectorBits + 7) / 8);
+
+   auto t0 = std::chrono::steady_clock::now();
+
+   while(r.bits < nbits && (maxErrors == 0 || r.errors < maxErrors)) {
+
+      int n = (nbits - r.bits < (uint64_t) vectorBits) ? (int)(nbits - r.bits) : vectorBits;
+      uint64_t errors;
+
+      prbs.generate(tx.data(), n);
+      errors = engine.probeBits(tx.data(), n);
+
+      r.bits += n;
+      r.errors += errors;
+
+      if(errors)
+         printDebug("BERTester::run " + std::to_string(errors) + " errors at bit " + std::to_string(r.bits - n), 2);
+   }
+
+   r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   r.bitRate = (r.seconds > 0) ? r.bits / r.seconds : 0;
+
+   // Poisson bounds of the error count
+   if(r.bits) {
+      double z = 1.959964;    // two-sided BER_CONFIDENCE
+      r.ber = (double) r.errors / r.bits;
+      r.lower = r.errors ? chiSquare(2.0 * r.errors, -z) / 2 / r.bits : 0;
+      r.upper = chiSquare(2.0 * r.errors + 2, z) / 2 / r.bits;
+   }
+
+   printDebug("BERTester::run end", 1);
+
+   return r;
+}
+
+void BERTester::printResult(ber_result r) {
+
+   printf("I: BER PRBS%d: %lu bits, %lu errors, BER %.2e (%d%% confidence %.2e - %.2e), %.2f Mbit/s\n",
+      prbs.getOrder(), (unsigned long) r.bits, (unsigned long) r.errors, r.ber,
+      (int)(BER_CONFIDENCE * 100), r.lower, r.upper, r.bitRate / 1E6);
+}
@@ -0,0 +1,475 @@
+#include "bitvector.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#define BITVECTOR_X86
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BITVECTOR_NEON
+#endif
+
+//
+// scalar kernels
+//
+
+static void copyScalar(unsigned char *dst, const unsigned char *src, int off, int nbytes, int srcBytes) {
+
+   int k = 0;
+
+   if (off == 0) {
+      memmove(dst, src, nbytes);
+      return;
+   }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   for (; (k + 8 <= nbytes) && (k + 9 <= srcBytes); k += 8) {
+      uint64_t w, out;
+      memcpy(&w, src + k, 8);
+      out = (w >> off) | ((uint64_t) src[k + 8] << (64 - off));
+      memcpy(dst + k, &out, 8);
+   }
+#endif
+
+   for (; k < nbytes; k++)
+      dst[k] = (src[k] >> off) | (((k + 1 < srcBytes) ? src[k + 1] : 0) << (8 - off));
+}
+
+static uint64_t mismatchScalar(const unsigned char *a, const unsigned char *b, int nbytes) {
+
+   uint64_t count = 0;
+   int k = 0;
+
+   for (; k + 8 <= nbytes; k += 8) {
+      uint64_t wa, wb;
+      memcpy(&wa, a + k, 8);
+      memcpy(&wb, b + k, 8);
+      count += __builtin_popcountll(wa ^ wb);
+   }
+
+   for (; k < nbytes; k++)
+      count += __builtin_popcount(a[k] ^ b[k]);
+
+   return count;
+}
+
+static void patternScalar(unsigned char *dst, uint32_t word, int nbytes) {
+
+   int k = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   uint64_t w = word | ((uint64_t) word << 32);
+   for (; k + 8 <= nbytes; k += 8)
+      memcpy(dst + k, &w, 8);
+#endif
+
+   for (; k < nbytes; k++)
+      dst[k] = word >> (8 * (k & 3));
+}
+
+static const bit_kernels scalarKernels = { "scalar", copyScalar, mismatchScalar, patternScalar };
+
+//
+// x86 kernels
+//
+
+#ifdef BITVECTOR_X86
+
+static void copySSE2(unsigned char *dst, const unsigned char *src, int off, int nbytes, int srcBytes) {
+
+   int k = 0;
+
+   if (off) {
+      __m128i r = _mm_cvtsi32_si128(off), l = _mm_cvtsi32_si128(64 - off);
+      for (; (k + 16 <= nbytes) && (k + 24 <= srcBytes); k += 16) {
+         __m128i v0 = _mm_loadu_si128((const __m128i *)(src + k));
+         __m128i v1 = _mm_loadu_si128((const __m128i *)(src + k + 8));
+         _mm_storeu_si128((__m128i *)(dst + k), _mm_or_si128(_mm_srl_epi64(v0, r), _mm_sll_epi64(v1, l)));
+      }
+   }
+
+   copyScalar(dst + k, src + k, off, nbytes - k, srcBytes - k);
+}
+
+// popcount of bytes with shifts and masks, summed by SAD
+static uint64_t mismatchSSE2(const unsigned char *a, const unsigned char *b, int nbytes) {
+
+   const __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33), m4 = _mm_set1_epi8(0x0F);
+   __m128i acc = _mm_setzero_si128();
+   int k = 0;
+
+   for (; k + 16 <= nbytes; k += 16) {
+      __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + k)), _mm_loadu_si128((const __m128i *)(b + k)));
+      x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+      x = _mm_add_epi8(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+      x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(x, _mm_setzero_si128()));
+   }
+
+   uint64_t lanes[2];
+   _mm_storeu_si128((__m128i *) lanes, acc);
+
+   return lanes[0] + lanes[1] + mismatchScalar(a + k, b + k, nbytes - k);
+}
+
+static void patternSSE2(unsigned char *dst, uint32_t word, int nbytes) {
+
+   __m128i v = _mm_set1_epi32(word);
+   int k = 0;
+
+   for (; k + 16 <= nbytes; k += 16)
+      _mm_storeu_si128((__m128i *)(dst + k), v);
+
+   patternScalar(dst + k, word, nbytes - k);
+}
+
+__attribute__((target("avx2")))
+static void copyAVX2(unsigned char *dst, const unsigned char *src, int off, int nbytes, int srcBytes) {
+
+   int k = 0;
+
+   if (off) {
+      __m128i r = _mm_cvtsi32_si128(off), l = _mm_cvtsi32_si128(64 - off);
+      for (; (k + 32 <= nbytes) && (k + 40 <= srcBytes); k += 32) {
+         __m256i v0 = _mm256_loadu_si256((const __m256i *)(src + k));
+         __m256i v1 = _mm256_loadu_si256((const __m256i *)(src + k + 8));
+         _mm256_storeu_si256((__m256i *)(dst + k), _mm256_or_si256(_mm256_srl_epi64(v0, r), _mm256_sll_epi64(v1, l)));
+      }
+   }
+
+   copySSE2(dst + k, src + k, off, nbytes - k, srcBytes - k);
+}
+
+// popcount of nibbles by table lookup, summed by SAD
+__attribute__((target("avx2")))
+static uint64_t mismatchAVX2(const unsigned char *a, const unsigned char *b, int nbytes) {
+
+   const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+   const __m256i m4 = _mm256_set1_epi8(0x0F);
+   __m256i acc = _mm256_setzero_si256();
+   int k = 0;
+
+   for (; k + 32 <= nbytes; k += 32) {
+      __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + k)), _mm256_loadu_si256((const __m256i *)(b + k)));
+      __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(x, m4)),
+         _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), m4)));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+   }
+
+   uint64_t lanes[4];
+   _mm256_storeu_si256((__m256i *) lanes, acc);
+
+   return lanes[0] + lanes[1] + lanes[2] + lanes[3] + mismatchSSE2(a + k, b + k, nbytes - k);
+}
+
+__attribute__((target("avx2")))
+static void patternAVX2(unsigned char *dst, uint32_t word, int nbytes) {
+
+   __m256i v = _mm256_set1_epi32(word);
+   int k = 0;
+
+   for (; k + 32 <= nbytes; k += 32)
+      _mm256_storeu_si256((__m256i *)(dst + k), v);
+
+   patternSSE2(dst + k, word, nbytes - k);
+}
+
+static const bit_kernels sse2Kernels = { "SSE2", copySSE2, mismatchSSE2, patternSSE2 };
+static const bit_kernels avx2Kernels = { "AVX2", copyAVX2, mismatchAVX2, patternAVX2 };
+
+#endif
+
+//
+// ARM kernels
+//
+
+#ifdef BITVECTOR_NEON
+
+static void copyNEON(unsigned char *dst, const unsigned char *src, int off, int nbytes, int srcBytes) {
+
+   int k = 0;
+
+   if (off) {
+      int64x2_t r = vdupq_n_s64(-off), l = vdupq_n_s64(64 - off);
+      for (; (k + 16 <= nbytes) && (k + 24 <= srcBytes); k += 16) {
+         uint64x2_t v0 = vreinterpretq_u64_u8(vld1q_u8(src + k));
+         uint64x2_t v1 = vreinterpretq_u64_u8(vld1q_u8(src + k + 8));
+         vst1q_u8(dst + k, vreinterpretq_u8_u64(vorrq_u64(vshlq_u64(v0, r), vshlq_u64(v1, l))));
+      }
+   }
+
+   copyScalar(dst + k, src + k, off, nbytes - k, srcBytes - k);
+}
+
+static uint64_t mismatchNEON(const unsigned char *a, const unsigned char *b, int nbytes) {
+
+   uint64_t count = 0;
+   int k = 0;
+
+   for (; k + 16 <= nbytes; k += 16)
+      count += vaddvq_u8(vcntq_u8(veorq_u8(vld1q_u8(a + k), vld1q_u8(b + k))));
+
+   return count + mismatchScalar(a + k, b + k, nbytes - k);
+}
+
+static void patternNEON(unsigned char *dst, uint32_t word, int nbytes) {
+
+   uint8x16_t v = vreinterpretq_u8_u32(vdupq_n_u32(word));
+   int k = 0;
+
+   for (; k + 16 <= nbytes; k += 16)
+      vst1q_u8(dst + k, v);
+
+   patternScalar(dst + k, word, nbytes - k);
+}
+
+static const bit_kernels neonKernels = { "NEON", copyNEON, mismatchNEON, patternNEON };
+
+#endif
+
+std::vector<const bit_kernels *> bitAvailableKernels(void) {
+
+   std::vector<const bit_kernels *> list = { &scalarKernels };
+
+#ifdef BITVECTOR_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("sse2"))
+      list.push_back(&sse2Kernels);
+   if (__builtin_cpu_supports("avx2"))
+      list.push_back(&avx2Kernels);
+#endif
+
+#ifdef BITVECTOR_NEON
+   list.push_back(&neonKernels);
+#endif
+
+   return list;
+}
+
+// best kernels of this CPU unless selected
+static const bit_kernels *&current(void) {
+   static const bit_kernels *k = bitAvailableKernels().back();
+   return k;
+}
+
+const bit_kernels *bitKernels(void) {
+   return current();
+}
+
+bool bitSelectKernels(std::string name) {
+
+   std::vector<const bit_kernels *> list = bitAvailableKernels();
+
+   for (unsigned int i = 0; i < list.size(); i++) {
+      if (name == list[i]->name) {
+         current() = list[i];
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void bitCopy(unsigned char *dst, int dpos, const unsigned char *src, int spos, int nbits) {
+
+   if (nbits <= 0)
+      return;
+
+   unsigned char *d = dst + dpos / 8;
+   const unsigned char *s = src + spos / 8;
+   int doff = dpos & 7;
+   int soff = spos & 7;
+
+   // head bits align destination to byte
+   if (doff) {
+      int h = (8 - doff < nbits) ? 8 - doff : nbits;
+      bitPut(d, doff, bitGet(s, soff, h), h);
+      d++;
+      soff += h;
+      s += soff / 8;
+      soff &= 7;
+      nbits -= h;
+   }
+
+   int full = nbits / 8;
+
+   if (full)
+      current()->copy(d, s, soff, full, (soff + nbits + 7) / 8);
+
+   if (nbits & 7)
+      bitPut(d + full, 0, bitGet(s, soff + 8 * full, nbits & 7), nbits & 7);
+}
+
+void bitShiftRight(unsigned char *dst, const unsigned char *src, int nbits, int n) {
+   bitCopy(dst, 0, src, n, nbits - n);
+}
+
+bool bitEqual(const unsigned char *a, const unsigned char *b, int nbits) {
+
+   int full = nbits / 8;
+
+   if (memcmp(a, b, full) != 0)
+      return false;
+
+   return (nbits & 7) ? (((a[full] ^ b[full]) & ((1 << (nbits & 7)) - 1)) == 0) : true;
+}
+
+uint64_t bitMismatches(const unsigned char *a, const unsigned char *b, int nbits) {
+
+   int full = nbits / 8;
+   uint64_t count = current()->mismatch(a, b, full);
+
+   if (nbits & 7)
+      count += __builtin_popcount((a[full] ^ b[full]) & ((1 << (nbits & 7)) - 1));
+
+   return count;
+}
+
+uint64_t bitCount(const unsigned char *a, int nbits) {
+
+   uint64_t count = 0;
+   int full = nbits / 8;
+
+   for (int k = 0; k < full; k++)
+      count += __builtin_popcount(a[k]);
+
+   if (nbits & 7)
+      count += __builtin_popcount(a[full] & ((1 << (nbits & 7)) - 1));
+
+   return count;
+}
+
+void bitFill(unsigned char *dst, int pos, int nbits, int value) {
+
+   uint32_t word = value ? 0xFFFFFFFF : 0;
+
+   // head and tail bits are merged, whole bytes are set
+   while (nbits > 0 && (pos & 7)) {
+      int h = (8 - (pos & 7) < nbits) ? 8 - (pos & 7) : nbits;
+      bitPut(dst, pos, word, h);
+      pos += h;
+      nbits -= h;
+   }
+
+   memset(dst + pos / 8, value ? 0xFF : 0x00, nbits / 8);
+
+   if (nbits & 7)
+      bitPut(dst, pos + (nbits & ~7), word, nbits & 7);
+}
+
+void bitPattern(unsigned char *dst, int nbits, uint32_t word) {
+
+   int nbytes = (nbits + 7) / 8;
+
+   current()->pattern(dst, word, nbytes);
+
+   if (nbits & 7)
+      dst[nbytes - 1] &= (1 << (nbits & 7)) - 1;
+}
+
+#define BENCH_BYTES     (1024 * 1024)
+#define BENCH_SECONDS   0.2
+
+#define CHECK_BYTES     1024
+#define CHECK_ROUNDS    4000
+
+// random vectors where kernels k give other bits than scalar kernels: lengths and
+// offsets are random so odd lengths, unaligned heads and tails are covered
+static int checkKernels(const bit_kernels *k) {
+
+   std::vector<unsigned char> a(CHECK_BYTES + 8), b(CHECK_BYTES + 8);
+   std::vector<unsigned char> ref(CHECK_BYTES + 16), res(CHECK_BYTES + 16);
+   std::vector<unsigned char> refPat(CHECK_BYTES), resPat(CHECK_BYTES);
+   int bad = 0;
+
+   srand(1);
+
+   for (int i = 0; i < CHECK_ROUNDS; i++) {
+
+      int nbits = 1 + rand() % (CHECK_BYTES * 8 - 64);
+      int spos = rand() % 64;
+      int dpos = rand() % 64;
+      uint32_t word = rand();
+
+      for (unsigned int j = 0; j < a.size(); j++) {
+         a[j] = rand();
+         b[j] = (rand() % 16) ? a[j] : rand();
+      }
+      for (unsigned int j = 0; j < ref.size(); j++)
+         ref[j] = res[j] = rand();
+
+      current() = &scalarKernels;
+      bitCopy(ref.data(), dpos, a.data(), spos, nbits);
+      uint64_t refCount = bitMismatches(a.data(), b.data(), nbits);
+      bitPattern(refPat.data(), nbits, word);
+
+      current() = k;
+      bitCopy(res.data(), dpos, a.data(), spos, nbits);
+      uint64_t resCount = bitMismatches(a.data(), b.data(), nbits);
+      bitPattern(resPat.data(), nbits, word);
+
+      if ((ref != res) || (refCount != resCount) ||
+         memcmp(refPat.data(), resPat.data(), (nbits + 7) / 8))
+         bad++;
+   }
+
+   return bad;
+}
+
+// GB/s of fn repeated for BENCH_SECONDS
+template <typename F>
+static double measure(F fn) {
+
+   long loops = 0;
+   double elapsed = 0;
+   auto t0 = std::chrono::steady_clock::now();
+
+   while (elapsed < BENCH_SECONDS) {
+      fn();
+      loops++;
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   }
+
+   return (double) loops * BENCH_BYTES / elapsed / 1E9;
+}
+
+void bitBenchmark(void) {
+
+   std::vector<unsigned char> a(BENCH_BYTES + 8), b(BENCH_BYTES + 8), c(BENCH_BYTES + 8);
+   const bit_kernels *selected = current();
+   volatile uint64_t sink = 0;
+
+   for (int i = 0; i < BENCH_BYTES + 8; i++) {
+      a[i] = i * 0x9D;
+      b[i] = (i % 97) ? a[i] : ~a[i];
+   }
+
+   std::vector<const bit_kernels *> list = bitAvailableKernels();
+
+   for (unsigned int i = 0; i < list.size(); i++) {
+
+      if (list[i] != &scalarKernels) {
+         int bad = checkKernels(list[i]);
+         if (bad)
+            printf("E: bitvector %s differs from scalar kernels on %d of %d random vectors\n", list[i]->name, bad, CHECK_ROUNDS);
+         else printf("I: bitvector %s matches scalar kernels on %d random vectors\n", list[i]->name, CHECK_ROUNDS);
+      }
+
+      current() = list[i];
+
+      double copy = measure([&]() { bitCopy(c.data(), 5, a.data(), 3, BENCH_BYTES * 8); });
+      double mismatch = measure([&]() { sink = sink + bitMismatches(a.data(), b.data(), BENCH_BYTES * 8); });
+      double pattern = measure([&]() { bitPattern(c.data(), BENCH_BYTES * 8, 0x80000001); });
+
+      printf("I: bitvector %-8s copy %6.2f GB/s  mismatch %6.2f GB/s  pattern %6.2f GB/s%s\n",
+         list[i]->name, copy, mismatch, pattern, (list[i] == selected) ? "  (selected)" : "");
+   }
+
+   current() = selected;
+}
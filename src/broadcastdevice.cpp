@@ -0,0 +1,125 @@
+#include "broadcastdevice.h"
+#include <string.h>
+
+BroadcastDevice::BroadcastDevice(XVCDriver *p, bool v, int dl) {
+
+   primary = p;
+   verbose = v;
+   debugLevel = dl;
+   setName("BROADCAST");
+
+   // expose primary chain target
+   idcode = primary->getIdCode();
+   idcmd = primary->getIdCmd();
+   irlen = primary->getIrLen();
+   desc = primary->getDescription();
+   detected = primary->isDetected();
+}
+
+BroadcastDevice::~BroadcastDevice() {
+
+   printSummary();
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+   }
+   startCond.notify_all();
+
+   for(unsigned int i=0; i<chains.size(); i++)
+      chains[i]->worker.join();
+}
+
+void BroadcastDevice::addChain(XVCDriver *d) {
+
+   std::unique_ptr<chain_t> c(new chain_t);
+
+   c->drv.reset(d);
+   c->generation = generation;
+   c->mismatches = 0;
+
+   if(d->getIdCode() != idcode)
+      printf("WARNING: BroadcastDevice: chain %d idcode 0x%X differs from primary idcode 0x%X\n",
+         (int) chains.size() + 1, d->getIdCode(), idcode);
+
+   c->worker = std::thread(&BroadcastDevice::run, this, c.get());
+   chains.push_back(std::move(c));
+}
+
+unsigned long BroadcastDevice::getMismatchCount(int chain) {
+
+   if(chain < 1 || chain > (int) chains.size())
+      return 0;
+
+   return chains[chain-1]->mismatches;
+}
+
+void BroadcastDevice::printSummary(void) {
+
+   for(unsigned int i=0; i<chains.size(); i++) {
+      if(chains[i]->mismatches)
+         printf("I: BroadcastDevice: chain %d (%s) FAIL - %lu mismatching shifts\n",
+            i+1, chains[i]->drv->getName().c_str(), chains[i]->mismatches);
+      else
+         printf("I: BroadcastDevice: chain %d (%s) OK\n", i+1, chains[i]->drv->getName().c_str());
+   }
+}
+
+void BroadcastDevice::run(chain_t *c) {
+
+   std::unique_lock<std::mutex> guard(lock);
+
+   while(true) {
+
+      startCond.wait(guard, [&]{ return stop || c->generation != generation; });
+
+      if(stop)
+         return;
+
+      c->generation = generation;
+      int nbits = curBits;
+      unsigned char *buffer = curBuffer;
+      guard.unlock();
+
+      c->result.resize((nbits + 7) / 8);
+      c->drv->shift(nbits, buffer, c->result.data());
+
+      guard.lock();
+      if(--pending == 0)
+         doneCond.notify_one();
+   }
+}
+
+void BroadcastDevice::shift(int nbits, unsigned char *buffer, unsigned char *result) {
+
+   int nbytes = (nbits + 7) / 8;
+
+   trackTMS(nbits, buffer, buffer + (nbits + 7) / 8);
+
+   // wake up secondary chains, buffer is read only for every driver
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      curBits = nbits;
+      curBuffer = buffer;
+      pending = chains.size();
+      generation++;
+   }
+   startCond.notify_all();
+
+   primary->shift(nbits, buffer, result);
+
+   std::unique_lock<std::mutex> guard(lock);
+   doneCond.wait(guard, [&]{ return pending == 0; });
+
+   for(unsigned int i=0; i<chains.size(); i++) {
+
+      chain_t *c = chains[i].get();
+
+      if(memcmp(result, c->result.data(), nbytes) != 0) {
+
+         if(c->mismatches++ == 0 || debugLevel >= 1)
+            printf("WARNING: BroadcastDevice: chain %d TDO mismatch on %d bits shift (total: %lu)\n",
+               i+1, nbits, c->mismatches);
+      }
+   }
+}
@@ -0,0 +1,129 @@
+#include "calibcache.h"
+#include "bertester.h"
+#include <sstream>
+#include <iomanip>
+#include <stdlib.h>
+
+void CalibCache::setKey(XVCDriver *d, std::string p) {
+
+   std::stringstream ss;
+   std::vector<chain_device> devs = d->getChain();
+
+   driver = d->getName();
+   idcode = d->getIdCode();
+
+   // port names become part of the file name
+   port = "";
+   for(unsigned int i=0; i<p.size(); i++)
+      port += isalnum(p[i]) ? p[i] : '_';
+
+   for(unsigned int i=0; i<devs.size(); i++)
+      ss << (i ? "," : "") << "0x" << std::hex << std::setw(8) << std::setfill('0') << devs[i].idcode;
+   ss << std::dec << "@" << d->getSelectedDevice();
+   chain = ss.str();
+}
+
+std::string CalibCache::getFilename(void) {
+
+   std::stringstream ss;
+
+   ss << dir << "/" << driver << "-" << port << "-" << std::hex << std::setw(8) << std::setfill('0') << idcode << ".txt";
+   return ss.str();
+}
+
+template <typename S> void CalibCache::setMeta(S *setup) {
+
+   setup->setMeta("driver", driver);
+   setup->setMeta("port", port);
+   setup->setMeta("chain", chain);
+   if(rtt >= 0)
+      setup->setMeta("rtt", std::to_string(rtt));
+}
+
+// cache entry of the key
+template <typename S> bool CalibCache::load(S *setup) {
+
+   std::string filename = getFilename();
+
+   if(!setup->loadFile(filename)) {
+      std::cout << "I: calibration cache: no entry " << filename << std::endl;
+      return false;
+   }
+
+   if(setup->getMeta("driver") != driver || setup->getMeta("port") != port || setup->getMeta("chain") != chain) {
+      std::cout << "I: calibration cache: entry " << filename << " belongs to another chain" << std::endl;
+      return false;
+   }
+
+   return true;
+}
+
+bool CalibCache::spotCheck(XVCDriver *d) {
+
+   BERTester ber(d, verbose);
+   ber_result r = ber.run(CACHE_CHECK_BITS, 1);
+
+   if(r.errors)
+      std::cout << "I: calibration cache: spot check failed" << std::endl;
+
+   return (r.errors == 0);
+}
+
+bool CalibCache::restore(AXIDevice *d, AXICalibrator *calib, AXISetup *setup, int freq) {
+
+   // cable fingerprint is measured also when calibration has to run, it is saved with the result
+   rtt = calib->measureRoundTrip();
+
+   if(!load(setup))
+      return false;
+
+   std::string cached = setup->getMeta("rtt");
+   if(rtt < 0 || cached.empty() || abs(rtt - atoi(cached.c_str())) > CACHE_RTT_TOLERANCE) {
+      std::cout << "I: calibration cache: round-trip delay changed (" << (cached.empty() ? "none" : cached) << " -> " << rtt << ")" << std::endl;
+      return false;
+   }
+
+   AXICalibItem *item = (freq != -1) ? setup->getItemByFrequency(freq) : setup->getItemByMaxFrequency();
+   if(item == nullptr)
+      return false;
+
+   d->setClockDiv(item->getClockDivisor());
+   d->setClockDelay(item->getClockDelay());
+
+   if(!spotCheck(d))
+      return false;
+
+   std::cout << "I: calibration cache: " << getFilename() << " validated" << std::endl;
+   return true;
+}
+
+bool CalibCache::restore(FTDIDevice *d, FTDISetup *setup, int freq) {
+
+   if(!load(setup))
+      return false;
+
+   FTDICalibItem *item = (freq != -1) ? setup->getItemByFrequency(freq) : setup->getItemByMaxFrequency();
+   if(item == nullptr)
+      return false;
+
+   d->setClockDiv(item->getClockDiv5(), item->getClockDivisor());
+   d->setTDOPosSampling((bool)item->getTDOSampling());
+
+   if(!spotCheck(d))
+      return false;
+
+   std::cout << "I: calibration cache: " << getFilename() << " validated" << std::endl;
+   return true;
+}
+
+bool CalibCache::save(AXISetup *setup) {
+
+   setMeta(setup);
+   return setup->saveFile(getFilename());
+}
+
+bool CalibCache::save(FTDISetup *setup) {
+
+   setMeta(setup);
+   return setup->saveFile(getFilename());
+}
@@ -0,0 +1,198 @@
+#include "driftmonitor.h"
+#include <chrono>
+
+DriftMonitor::DriftMonitor(AXIDevice *d, AXICalibrator *c, AXISetup *s, bool v, int dl) : gate(d) {
+
+   dev = d;
+   calib = c;
+   setup = s;
+   verbose = v;
+   debugLevel = dl;
+}
+
+DriftMonitor::~DriftMonitor() {
+   stop();
+}
+
+void DriftMonitor::printDebug(std::string msg, int lvl) {
+   if (debugLevel >= lvl)
+      std::cout << msg << std::endl;
+}
+
+void DriftMonitor::start(BackgroundCalibrator *bg) {
+
+   worker = std::thread(&DriftMonitor::run, this, bg);
+}
+
+void DriftMonitor::stop(void) {
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      stopped = true;
+   }
+   stopCond.notify_all();
+
+   if(worker.joinable())
+      worker.join();
+}
+
+// false when the monitor is stopped meanwhile
+bool DriftMonitor::wait(int sec) {
+
+   std::unique_lock<std::mutex> guard(lock);
+   return !stopCond.wait_for(guard, std::chrono::seconds(sec), [this]{ return stopped; });
+}
+
+std::vector<drift_event> DriftMonitor::getEvents(void) {
+
+   std::lock_guard<std::mutex> guard(lock);
+   return events;
+}
+
+drift_metrics DriftMonitor::getMetrics(void) {
+
+   std::lock_guard<std::mutex> guard(lock);
+   return metrics;
+}
+
+void DriftMonitor::printMetrics(void) {
+
+   std::lock_guard<std::mutex> guard(lock);
+   std::cout << "I: drift monitor: " << metrics.checks << " checks, " << metrics.delayShifts << " delay shifts, " <<
+      metrics.stepDowns << " steps down, " << metrics.stepUps << " steps up, " << metrics.lost << " lost" << std::endl;
+}
+
+void DriftMonitor::run(BackgroundCalibrator *bg) {
+
+   while(bg && !bg->isDone())
+      if(!wait(period))
+         return;
+
+   // clients run at the point chosen at start until the first adjustment
+   gate.setClientClock(dev->getClockSetting());
+   home = gate.getClientClock();
+   eye = {-1, -1, 0};
+   homeEye = eye;
+
+   std::cout << "I: drift monitor: checking window of divisor " << home.divisor << " delay " << home.delay <<
+      " every " << period << " s" << std::endl;
+
+   calib->setGate(&gate);
+
+   while(wait(period)) {
+      gate.enter();
+      check();
+      gate.leave();
+   }
+
+   calib->setGate(nullptr);
+}
+
+// window of the current point tracked from its last edges, the current point is left
+// for the window centre or a slower point when it gets close to an edge
+void DriftMonitor::check(void) {
+
+   clock_setting c = gate.getClientClock();
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      metrics.checks++;
+   }
+
+   // initial point is tried again after a while, a wider window is required to go back
+   if(c.divisor != home.divisor && metrics.checks - lastStep >= DRIFT_STEPUP) {
+
+      axi_eye e = homeEye;
+      lastStep = metrics.checks;
+
+      if(calib->trackEye(home.divisor, (homeEye.minDelay + homeEye.maxDelay) / 2, e) && e.validPoints >= 2 * DRIFT_MIN_EYE) {
+         homeEye = e;
+         eye = e;
+         record(DRIFT_STEP_UP, home.divisor, (e.minDelay + e.maxDelay) / 2, e);
+         return;
+      }
+   }
+
+   if(!calib->trackEye(c.divisor, c.delay, eye) || eye.validPoints < DRIFT_MIN_EYE) {
+      stepDown(c.divisor, c.delay);
+      return;
+   }
+
+   lost = false;
+
+   int margin = eye.validPoints / 4;
+   if(c.delay - eye.minDelay < margin || eye.maxDelay - c.delay < margin)
+      record(DRIFT_DELAY, c.divisor, (eye.minDelay + eye.maxDelay) / 2, eye);
+
+   if(c.divisor == home.divisor)
+      homeEye = eye;
+
+   printDebug("DriftMonitor::check window " + std::to_string(eye.minDelay) + "-" + std::to_string(eye.maxDelay) +
+      " - clkdiv: " + std::to_string(c.divisor) + " - clkdelay: " + std::to_string(c.delay), 2);
+}
+
+// fastest calibrated point slower than the current one with a wide enough window
+bool DriftMonitor::stepDown(int cdiv, int cdel) {
+
+   int freq = 100000000 / ((cdiv + 1) * 2);
+
+   while(setup) {
+
+      AXICalibItem *next = nullptr;
+
+      for(int i=0; i<setup->getListSize(); i++) {
+         AXICalibItem *item = setup->getItemByIndex(i);
+         if(item->getClockFrequency() < freq && (next == nullptr || item->getClockFrequency() > next->getClockFrequency()))
+            next = item;
+      }
+
+      if(next == nullptr)
+         break;
+
+      axi_eye e = {-1, -1, 0};
+      if(calib->trackEye(next->getClockDivisor(), next->getClockDelay(), e) && e.validPoints >= DRIFT_MIN_EYE) {
+         eye = e;
+         lastStep = metrics.checks;
+         lost = false;
+         record(DRIFT_STEP_DOWN, next->getClockDivisor(), (e.minDelay + e.maxDelay) / 2, e);
+         return true;
+      }
+
+      freq = next->getClockFrequency();
+   }
+
+   // reported once until a valid point is found again
+   if(!lost) {
+      lost = true;
+      record(DRIFT_LOST, cdiv, cdel, eye);
+   }
+
+   return false;
+}
+
+void DriftMonitor::record(int type, int cdiv, int cdel, axi_eye &e) {
+
+   static const char *names[] = { "delay shift", "step down", "step up", "no valid point" };
+   clock_setting c = gate.getClientClock();
+   drift_event ev = {time(NULL), type, c.divisor, c.delay, cdiv, cdel, e};
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      events.push_back(ev);
+      switch(type) {
+         case DRIFT_DELAY: metrics.delayShifts++; break;
+         case DRIFT_STEP_DOWN: metrics.stepDowns++; break;
+         case DRIFT_STEP_UP: metrics.stepUps++; break;
+         case DRIFT_LOST: metrics.lost++; break;
+      }
+   }
+
+   // clients run at the new point once the gate is left
+   if(type != DRIFT_LOST)
+      gate.setClientClock({cdiv, cdel, false, false});
+
+   std::cout << "I: drift monitor: " << names[type] << " - clkdiv: " << c.divisor << " -> " << cdiv <<
+      " - clkdelay: " << c.delay << " -> " << cdel << " - window: " << e.minDelay << "-" << e.maxDelay << std::endl;
+
+   printMetrics();
+}
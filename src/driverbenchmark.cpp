@@ -0,0 +1,71 @@
+#include "driverbenchmark.h"
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+void DriverBenchmark::addDriver(XVCDriver *d, std::string label) {
+   drivers.push_back(d);
+   labels.push_back(label);
+}
+
+// bit/s of bulk shifts in SHIFT-DR (BYPASS) for BENCH_TIME seconds
+double DriverBenchmark::measure(XVCDriver *d) {
+
+   int nbytes = BENCH_BITS / 8;
+   std::vector<unsigned char> buffer(2 * nbytes, 0);
+   std::vector<unsigned char> result(nbytes);
+   long bits = 0;
+
+   for(int i=0; i<nbytes; i++)
+      buffer[nbytes + i] = i;
+
+   auto t0 = std::chrono::steady_clock::now();
+   double elapsed = 0;
+
+   while(elapsed < BENCH_TIME) {
+      d->shift(BENCH_BITS, buffer.data(), result.data());
+      bits += BENCH_BITS;
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   }
+
+   return bits / elapsed;
+}
+
+void DriverBenchmark::run(void) {
+
+   std::vector<double> single(drivers.size()), concurrent(drivers.size());
+   double sum = 0, aggregate = 0;
+
+   for(unsigned int i=0; i<drivers.size(); i++)
+      drivers[i]->startBypass();
+
+   for(unsigned int i=0; i<drivers.size(); i++) {
+      single[i] = measure(drivers[i]);
+      sum += single[i];
+      printf("I: benchmark %s: %.2f Mbit/s\n", labels[i].c_str(), single[i] / 1E6);
+   }
+
+   if(drivers.size() > 1) {
+
+      std::vector<std::thread> workers;
+      for(unsigned int i=0; i<drivers.size(); i++)
+         workers.push_back(std::thread([this, i, &concurrent]() { concurrent[i] = measure(drivers[i]); }));
+      for(unsigned int i=0; i<workers.size(); i++)
+         workers[i].join();
+
+      for(unsigned int i=0; i<drivers.size(); i++) {
+         aggregate += concurrent[i];
+         if(verbose)
+            printf("DriverBenchmark: %s concurrent: %.2f Mbit/s\n", labels[i].c_str(), concurrent[i] / 1E6);
+      }
+
+      printf("I: benchmark aggregate on %d chains: %.2f Mbit/s (%.0f%% of sum of single chains, %.2fx best single chain)\n",
+         (int) drivers.size(), aggregate / 1E6, 100 * aggregate / sum, aggregate / *std::max_element(single.begin(), single.end()));
+   }
+
+   // back to RUN-TEST/IDLE
+   unsigned char buf[2] = { 0x1F, 0x00 };
+   unsigned char res[1];
+   for(unsigned int i=0; i<drivers.size(); i++)
+      drivers[i]->shift(6, buf, res);
+}
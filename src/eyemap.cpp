@@ -0,0 +1,182 @@
+#include "eyemap.h"
+#include <algorithm>
+#include <cmath>
+
+// magic, row count, then for each row divisor, first delay, cell count and cells
+bool EyeMap::saveFile(std::string filename) {
+
+   FILE *fp = fopen(filename.c_str(), "wb");
+   if(!fp)
+      return false;
+
+   uint32_t n = rows.size();
+   bool ok = (fwrite(EYEMAP_MAGIC, 1, 8, fp) == 8) && (fwrite(&n, 4, 1, fp) == 1);
+
+   for(unsigned int i=0; ok && i<rows.size(); i++) {
+      uint32_t hdr[3] = { (uint32_t) rows[i].cdiv, (uint32_t) rows[i].firstDelay, (uint32_t) rows[i].cells.size() };
+      ok = (fwrite(hdr, 4, 3, fp) == 3) &&
+         (fwrite(rows[i].cells.data(), sizeof(eye_cell), rows[i].cells.size(), fp) == rows[i].cells.size());
+   }
+
+   fclose(fp);
+   return ok;
+}
+
+bool EyeMap::loadFile(std::string filename) {
+
+   FILE *fp = fopen(filename.c_str(), "rb");
+   if(!fp)
+      return false;
+
+   char magic[8];
+   uint32_t n;
+   bool ok = (fread(magic, 1, 8, fp) == 8) && (memcmp(magic, EYEMAP_MAGIC, 8) == 0) && (fread(&n, 4, 1, fp) == 1);
+
+   rows.clear();
+   for(uint32_t i=0; ok && i<n; i++) {
+      uint32_t hdr[3];
+      eye_row row;
+      ok = (fread(hdr, 4, 3, fp) == 3) && (hdr[2] <= 1u << 20);
+      if(!ok)
+         break;
+      row.cdiv = hdr[0];
+      row.firstDelay = hdr[1];
+      row.cells.resize(hdr[2]);
+      ok = (fread(row.cells.data(), sizeof(eye_cell), hdr[2], fp) == hdr[2]);
+      rows.push_back(row);
+   }
+
+   fclose(fp);
+   if(!ok)
+      rows.clear();
+
+   return ok;
+}
+
+bool EyeMap::exportFile(std::string filename) {
+
+   FILE *fp = fopen(filename.c_str(), "wt");
+   if(!fp)
+      return false;
+
+   bool json = (filename.size() >= 5) && (filename.compare(filename.size() - 5, 5, ".json") == 0);
+   bool ok = json ? exportJSON(fp) : exportCSV(fp);
+
+   fclose(fp);
+   return ok;
+}
+
+bool EyeMap::exportCSV(FILE *fp) {
+
+   fprintf(fp, "divisor,frequency,delay,bits,errors,ber\n");
+
+   for(unsigned int i=0; i<rows.size(); i++) {
+      int cfreq = 100000000 / ((rows[i].cdiv + 1) * 2);
+      for(unsigned int j=0; j<rows[i].cells.size(); j++) {
+         eye_cell &c = rows[i].cells[j];
+         fprintf(fp, "%d,%d,%d,%u,%u,%.3e\n", rows[i].cdiv, cfreq, rows[i].firstDelay + j,
+            c.bits, c.errors, c.bits ? (double) c.errors / c.bits : 0);
+      }
+   }
+
+   return true;
+}
+
+bool EyeMap::exportJSON(FILE *fp) {
+
+   fprintf(fp, "{\n  \"rows\": [\n");
+
+   for(unsigned int i=0; i<rows.size(); i++) {
+      fprintf(fp, "    { \"divisor\": %d, \"frequency\": %d, \"firstDelay\": %d,\n", rows[i].cdiv,
+         100000000 / ((rows[i].cdiv + 1) * 2), rows[i].firstDelay);
+      fprintf(fp, "      \"bits\": [");
+      for(unsigned int j=0; j<rows[i].cells.size(); j++)
+         fprintf(fp, "%s%u", j ? "," : "", rows[i].cells[j].bits);
+      fprintf(fp, "],\n      \"errors\": [");
+      for(unsigned int j=0; j<rows[i].cells.size(); j++)
+         fprintf(fp, "%s%u", j ? "," : "", rows[i].cells[j].errors);
+      fprintf(fp, "] }%s\n", (i + 1 < rows.size()) ? "," : "");
+   }
+
+   fprintf(fp, "  ]\n}\n");
+   return true;
+}
+
+// share of error free bits of a cell: 1 for a clean cell, 0 from a bit error rate of 0.5
+// (random TDO), cells outside the row count as failing
+static double cellGood(eye_row &row, int j) {
+
+   if(j < 0 || j >= (int) row.cells.size() || row.cells[j].bits == 0)
+      return 0;
+
+   return std::max(0.0, 1.0 - 2.0 * row.cells[j].errors / row.cells[j].bits);
+}
+
+// cells with few errors next to a run are the slope of a soft edge: each one extends
+// its side of the run by its share of good bits, the delay is the centre of the
+// extended run so that it keeps the widest margin to the error counts on both sides
+bool EyeMap::getBestDelay(eye_row &row, int &delay, int &points) {
+
+   int best = -1, bestLen = 0;
+   double bestLow = 0, bestHigh = 0;
+   int start = -1;
+
+   for(unsigned int j=0; j<=row.cells.size(); j++) {
+      bool clean = (j < row.cells.size()) && (row.cells[j].errors == 0) && row.cells[j].bits;
+      if(clean && start == -1)
+         start = j;
+      if(!clean && start != -1) {
+         int len = j - start;
+         double low = 0, high = 0, g;
+         for(int k=start-1; (g = cellGood(row, k)) > 0; k--)
+            low += g;
+         for(int k=j; (g = cellGood(row, k)) > 0; k++)
+            high += g;
+         if(len > bestLen || (len == bestLen && low + high > bestLow + bestHigh)) {
+            bestLen = len;
+            best = start;
+            bestLow = low;
+            bestHigh = high;
+         }
+         start = -1;
+      }
+   }
+
+   if(best == -1)
+      return false;
+
+   double centre = ((best - bestLow) + (best + bestLen - 1 + bestHigh)) / 2;
+   delay = row.firstDelay + std::min(std::max((int) std::floor(centre), best), best + bestLen - 1);
+   points = bestLen;
+   return true;
+}
+
+void EyeMap::toSetup(AXISetup *setup) {
+
+   int id = 0;
+
+   setup->clear();
+
+   for(unsigned int i=0; i<rows.size(); i++) {
+
+      int delay, valid;
+      int cdiv = rows[i].cdiv;
+
+      if(!getBestDelay(rows[i], delay, valid))
+         continue;
+
+      if(valid < cdiv / 2)
+         continue;
+
+      AXICalibItem item;
+      item.setId(id++);
+      item.setClockDivisor(cdiv);
+      item.setClockDelay(delay);
+      item.setClockFrequency(100000000 / ((cdiv + 1) * 2));
+      item.setValidPoints(valid);
+      item.setEyeWidth((valid / float((cdiv + 1) * 2)) * 100);
+      setup->addItem(item);
+   }
+
+   setup->finalize();
+}
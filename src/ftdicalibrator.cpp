@@ -1,6 +1,9 @@
 #include "ftdicalibrator.h"
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
 
-FTDICalibrator::FTDICalibrator(FTDIDevice *d) {
+FTDICalibrator::FTDICalibrator(FTDIDevice *d) : engine(d) {
    dev = d;
 }
 
@@ -9,77 +12,239 @@ void FTDICalibrator::printDebug(std::string msg, int lvl) {
       std::cout << msg << std::endl;
 }
 
+// clock points from minFreq to maxFreq, frequencies below the range of the 60 MHz
+// base clock use the 12 MHz one (divide by 5 enabled)
+void FTDICalibrator::buildPoints(int minFreq, int maxFreq) {
+
+   points.clear();
+
+   if(minFreq < MIN_CFREQ_DIV5_OFF) {
+      int first = std::min(0xFFFF, dev->getDivisorByFrequency(DIV5_ON, std::max(minFreq, 1)));
+      for(int cdiv=first; cdiv>=0; cdiv--) {
+         int cfreq = dev->getFrequencyByDivisor(DIV5_ON, cdiv);
+         if(cfreq >= MIN_CFREQ_DIV5_OFF || cfreq > maxFreq)
+            break;
+         points.push_back({DIV5_ON, cdiv, cfreq});
+      }
+   }
+
+   int maxVal = std::min(0xFFFF, dev->getDivisorByFrequency(DIV5_OFF, std::max(minFreq, (int) MIN_CFREQ_DIV5_OFF + 1)));
+   int minVal = std::max(0, dev->getDivisorByFrequency(DIV5_OFF, maxFreq));
+
+   for(int cdiv=maxVal; cdiv>=minVal; cdiv--)
+      points.push_back({DIV5_OFF, cdiv, dev->getFrequencyByDivisor(DIV5_OFF, cdiv)});
+}
+
+bool FTDICalibrator::probe(int index, int tdoSampling, int loop) {
+
+   clock_point &p = points[index];
+
+   dev->setTDOPosSampling((bool)tdoSampling);
+   dev->setClockDiv(p.div5, p.divisor);
+   probes++;
+
+   // loop IDCODE reads in a single shift
+   int match = engine.probeIdCodes(loop);
+
+   // PRBS test on a long sequence, stops at first error
+   if(match == loop && berBits > 0) {
+      BERTester ber(dev, verbose, debugLevel);
+      ber.setPattern(berOrder);
+      ber.setGate(gate);
+      if(ber.run(berBits, 1).errors)
+         match = 0;
+   }
+
+   char msg[128];
+   sprintf(msg, "FTDICalibrator::probe: idcode %s - tdoSampling: %d - clkdiv: %d%s - clkfreq: %d",
+      (match == loop) ? "OK" : "FAIL", tdoSampling, p.divisor, p.div5 ? " (div5)" : "", p.frequency);
+   printDebug(msg, 2);
+
+   status[tdoSampling][index] = (match == loop);
+   return (match == loop);
+}
+
+// margin in % of the TCK period between a passing point and the nearest failing one of
+// the same edge, the clock next to the fastest point counts as failing when no faster
+// point failed (none above 30 MHz)
+int FTDICalibrator::getMargin(int index, int tdoSampling) {
+
+   int freq = points[index].frequency;
+   int fail = 0;
+
+   if(points.back().div5 || points.back().divisor > 0)
+      fail = points.back().div5 ? dev->getFrequencyByDivisor(DIV5_OFF, 0xFFFF) :
+         dev->getFrequencyByDivisor(DIV5_OFF, points.back().divisor - 1);
+
+   for(unsigned int i=0; i<points.size(); i++) {
+      if(status[tdoSampling][i] == 0 && (fail == 0 || abs(points[i].frequency - freq) * 1LL * fail <
+            abs(fail - freq) * 1LL * points[i].frequency))
+         fail = points[i].frequency;
+   }
+
+   if(fail == 0)
+      return 100;
+
+   return std::min(100LL, abs(fail - freq) * 100LL / fail);
+}
+
+// index of the highest passing point, -1 when the slowest one fails: points below a
+// passing one are expected to pass, the boundary found by bisection is accepted when
+// it and FCALIB_CONFIRM_POINTS points below pass again, otherwise bisection restarts below
+// the failing point
+int FTDICalibrator::searchEdge(int tdoSampling, int loop) {
+
+   int lo = 0;
+   int hi = points.size() - 1;
+
+   if(points.empty() || !probe(lo, tdoSampling, loop))
+      return -1;
+
+   if(hi > lo && probe(hi, tdoSampling, loop))
+      lo = hi;
+
+   while(true) {
+
+      while(hi - lo > 1) {
+         int mid = (lo + hi) / 2;
+         if(probe(mid, tdoSampling, loop))
+            lo = mid;
+         else
+            hi = mid;
+      }
+
+      int fail = -1;
+      for(int i=lo; i>=0 && i>=lo-FCALIB_CONFIRM_POINTS; i--) {
+         if(!probe(i, tdoSampling, loop)) {
+            fail = i;
+            break;
+         }
+      }
+
+      if(fail == -1)
+         return lo;
+      if(fail == 0)
+         return -1;
+
+      hi = fail;
+      lo = 0;
+   }
+}
+
 void FTDICalibrator::start(FTDISetup *setup, int minFreq, int maxFreq, int loop) {
 
    printDebug("FTDICalibrator::start start", 1);
 
    int id = 0;             // calibration id
-   int cdiv = 0;           // clock divisor
    int tdoSampling = 0;    // TDO sampling edge (0: negative, 1: positive)
-   int cfreq = 0;          // clock frequency
    int currIter = 0;
    int lastIter = 0;
+   int boundary[2] = {-1, -1};
 
    // reset previous calibration
    setup->clear();
+   buildPoints(minFreq, maxFreq);
+   status[0].assign(points.size(), -1);
+   status[1].assign(points.size(), -1);
+   probes = 0;
 
    std::cout << "I: calibration started" << std::endl;
 
-   int minVal = dev->getDivisorByFrequency(DIV5_OFF, maxFreq);
-   int maxVal = dev->getDivisorByFrequency(DIV5_OFF, minFreq);
-  
-   for(cdiv=maxVal; cdiv>=minVal; cdiv--) {
+   auto t0 = std::chrono::steady_clock::now();
+   double searchTime = 0;
+   long searchProbes = 0;
+
+   if(mode != FCALIB_SWEEP) {
 
       for(tdoSampling=0; tdoSampling<=1; tdoSampling++) {
 
-         currIter = float(maxVal-cdiv) / (maxVal-minVal) * 100;
-         if(currIter != lastIter) {    
-            printf("\r %d%%", currIter);
-            fflush(stdout);
-            lastIter = currIter;
-         }
+         boundary[tdoSampling] = searchEdge(tdoSampling, loop);
 
-         dev->setTDOPosSampling((bool)tdoSampling);
-         dev->setClockDiv(false, cdiv);
-         cfreq = dev->getFrequencyByDivisor(DIV5_OFF, cdiv);
-
-         int match = 0;
-         for(int i=0; i<loop; i++) {
-            uint32_t idcode = dev->probeIdCode();
-            if(idcode == dev->getIdCode())
-               match++;
-            else
-               break;
-         }
+         if(boundary[tdoSampling] >= 0) {
+            clock_point &p = points[boundary[tdoSampling]];
+            printf("I: %s edge: highest passing clock %d Hz (divisor %d%s)\n", tdoSampling ? "positive" : "negative",
+               p.frequency, p.divisor, p.div5 ? ", div5" : "");
+         } else
+            printf("I: %s edge: no passing clock\n", tdoSampling ? "positive" : "negative");
+      }
 
-         if(match == loop) {
+      searchTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      searchProbes = probes;
+   }
+
+   std::vector<int> valid[2] = {std::vector<int>(points.size()), std::vector<int>(points.size())};
+
+   for(unsigned int i=0; i<points.size(); i++) {
+
+      for(tdoSampling=0; tdoSampling<=1; tdoSampling++) {
+
+         if(mode != FCALIB_SEARCH) {
+            currIter = float(i) / (points.size() - 1 ? points.size() - 1 : 1) * 100;
+            if(currIter != lastIter) {
+               printf("\r %d%%", currIter);
+               fflush(stdout);
+               lastIter = currIter;
+            }
+            valid[tdoSampling][i] = probe(i, tdoSampling, loop);
+         } else
+            // only points up to the boundary that were probed and passed are stored
+            valid[tdoSampling][i] = ((int) i <= boundary[tdoSampling] && status[tdoSampling][i] == 1);
+      }
+   }
+
+   // margins once every probe result is known
+   for(unsigned int i=0; i<points.size(); i++) {
+
+      for(tdoSampling=0; tdoSampling<=1; tdoSampling++) {
+
+         if(valid[tdoSampling][i]) {
 
             FTDICalibItem item;
             item.setId(++id);
-            item.setClockDivisor(cdiv);
+            item.setClockDivisor(points[i].divisor);
+            item.setClockDiv5(points[i].div5);
             item.setTDOSampling(tdoSampling);
-            item.setClockFrequency(cfreq);
-
-            if(debugLevel) {
-               char msg[128];
-               sprintf(msg, "FTDICalibrator::startCalibration: idcode OK - tdoSampling: %d - clkdiv: %d - clkfreq: %d", tdoSampling, cdiv, cfreq);
-               printDebug(msg, 2);
-            }
+            item.setClockFrequency(points[i].frequency);
+            item.setMargin(getMargin(i, tdoSampling));
 
             setup->addItem(item);
+         }
+      }
+   }
 
-         } else {
+   double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+   long sweepProbes = 2 * points.size();
 
-            char msg[128];
-            sprintf(msg, "FTDICalibrator::startCalibration: idcode FAIL - tdoSampling: %d - clkdiv: %d - clkfreq: %d", tdoSampling, cdiv, cfreq);
-            printDebug(msg, 2);
-         }
+   if(mode != FCALIB_SWEEP)
+      printf("%sI: boundary search: %ld probes in %.2f s, exhaustive sweep: %ld probes (%.1fx)\n", (mode == FCALIB_CHECK) ? "\n" : "",
+         searchProbes, searchTime, sweepProbes, searchProbes ? float(sweepProbes) / searchProbes : 0);
+   if(mode != FCALIB_SEARCH)
+      printf("%sI: divisor sweep: %ld probes in %.2f s\n", (mode == FCALIB_SWEEP) ? "\n" : "",
+         probes - searchProbes, elapsed - searchTime);
+
+   // highest point of each edge below which the sweep found no failing one
+   if(mode == FCALIB_CHECK) {
+      for(tdoSampling=0; tdoSampling<=1; tdoSampling++) {
+
+         int edge = -1;
+         while(edge + 1 < (int) points.size() && valid[tdoSampling][edge + 1])
+            edge++;
+
+         const char *name = tdoSampling ? "positive" : "negative";
+         int fs = (boundary[tdoSampling] >= 0) ? points[boundary[tdoSampling]].frequency : 0;
+         int fw = (edge >= 0) ? points[edge].frequency : 0;
+
+         if(edge == boundary[tdoSampling])
+            printf("I: boundary check: %s edge: search and sweep agree at %d Hz\n", name, fs);
+         else
+            printf("E: boundary check: %s edge: search found %d Hz, sweep %d Hz\n", name, fs, fw);
       }
    }
 
    setup->finalize();
 
-   std::cout << std::endl;
+   if(verbose)
+      printf("FTDICalibrator: %ld probe shifts\n", engine.getShifts());
    printDebug("FTDICalibrator::start end", 1);
    std::cout << "I: calibration finished" << std::endl;
 }
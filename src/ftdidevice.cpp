@@ -1,7 +1,8 @@
 #include "ftdidevice.h"
+#include "bitvector.h"
 #include <sstream>
 
-FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const char *serial, char *busconf, bool v, int dl) {
+FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const char *serial, char *busconf, bool v, int dl, int backend) {
    
    int res = 0;
 
@@ -9,23 +10,18 @@ FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const ch
    debugLevel = dl;
    setName("FTDI");
 
-   if ((ftdi = ftdi_new()) == 0) {
-      std::string errmsg(ftdi_get_error_string(ftdi));
-      throw std::runtime_error("E: FTDIDevice failed allocation (" + errmsg + ")");
-   }
-
-   if(ftdi_set_interface(ftdi, interface) < 0) {
-      std::string errmsg(ftdi_get_error_string(ftdi));
-      throw std::runtime_error("E: FTDIDevice can't set interface (" + errmsg + ")");
-   }
+   if(backend == BACKEND_LIBUSB)
+      port = new FTDIUsbPort(vid, pid, interface, serial);
+   else if(backend == BACKEND_SIM)
+      port = new FTDISimPort(serial);
+   else
+      port = new FTDILibPort(vid, pid, interface, serial);
 
-   if (ftdi_usb_open_desc(ftdi, vid, pid, NULL, serial) < 0) {
-      std::string errmsg(ftdi_get_error_string(ftdi));
-      throw std::runtime_error("E: FTDIDevice can't open device (" + errmsg + ")");
-   }
+   if(verbose)
+      std::cout << "FTDIDevice: USB backend " << port->getName() << " serial " << port->getSerial() << std::endl;
 
-   ftdi_usb_reset(ftdi);
-   ftdi_set_latency_timer(ftdi, 1);
+   port->reset();
+   port->setLatencyTimer(latencyTimer);
 
    unsigned char buf[] = {
       DIS_DIV_5,
@@ -34,10 +30,9 @@ FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const ch
       0x82, 0x00, 0x00,
       SEND_IMMEDIATE };
 
-   ftdi_set_bitmode(ftdi, 0x0B, BITMODE_MPSSE);
+   port->setBitmode(0x0B, BITMODE_MPSSE);
 
-   ftdi_usb_purge_rx_buffer(ftdi);
-   ftdi_usb_purge_tx_buffer(ftdi);
+   port->purge();
   
    std::stringstream ss;
    if(busconf == nullptr)
@@ -53,6 +48,7 @@ FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const ch
    }
    
    if(mask.size() < 4) {
+      delete port;
       throw std::runtime_error("E: FTDIDevice bus config error: " + std::string(busconf));
    }
 
@@ -61,8 +57,11 @@ FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const ch
    buf[8] = mask[2];    // cbus_data
    buf[9] = mask[3];    // cbus_en
 
-   if ((res = ftdi_write_data(ftdi, buf, sizeof(buf))) != sizeof(buf)) {
-      std::string errmsg(ftdi_get_error_string(ftdi));
+   tmsHigh = buf[2] & 0x08;
+
+   if ((res = port->write(buf, sizeof(buf))) != sizeof(buf)) {
+      std::string errmsg(port->getError());
+      delete port;
       throw std::runtime_error("E: FTDIDevice error initializing MPSSE (" + errmsg + ")");
    }
 
@@ -75,9 +74,10 @@ FTDIDevice::FTDIDevice(int vid, int pid, enum ftdi_interface interface, const ch
 }
 
 FTDIDevice::~FTDIDevice() {
-   ftdi_usb_reset(ftdi);
-   ftdi_usb_close(ftdi);
-   ftdi_deinit(ftdi);
+   if(verbose)
+      planCache.printStats();
+   port->reset();
+   delete port;
 }
 
 int FTDIDevice::getDivisorByFrequency(bool div5, int freq) {
@@ -96,6 +96,9 @@ int FTDIDevice::getFrequencyByDivisor(bool div5, int div) {
 
 void FTDIDevice::setClockDiv(bool div5, int value) {
 
+   clkdiv5 = div5;
+   clkdiv = value;
+
    unsigned char div5word = div5?EN_DIV_5:DIS_DIV_5;
    unsigned char valueh = value>>8 & 0xFF;
    unsigned char valuel = value & 0xFF;
@@ -106,7 +109,7 @@ void FTDIDevice::setClockDiv(bool div5, int value) {
       SEND_IMMEDIATE
    };
 
-   ftdi_write_data(ftdi, buf, sizeof(buf)); 
+   port->write(buf, sizeof(buf));
 }
 
 void FTDIDevice::setClockFrequency(int freq) {
@@ -145,6 +148,28 @@ void FTDIDevice::setTDOPosSampling(bool value) {
    samplingEdge = value?POS_EDGE:NEG_EDGE;
 }
 
+void FTDIDevice::setTransferDepth(int v) {
+   if(v >= 1 && v <= MAX_INFLIGHT)
+      transferDepth = v;
+   else std::cout << "E: transfer depth out of range: " << v << std::endl;
+}
+
+// compiled plans depend on chunk size
+void FTDIDevice::setChunkSize(int v) {
+   if(v >= MIN_CHUNK && v <= MAX_DATA) {
+      chunkSize = v;
+      port->setChunkSize(v);
+      planCache.clear();
+   } else std::cout << "E: chunk size out of range: " << v << std::endl;
+}
+
+void FTDIDevice::setLatencyTimer(int v) {
+   if(v >= 1 && v <= 255) {
+      latencyTimer = v;
+      port->setLatencyTimer(v);
+   } else std::cout << "E: latency timer out of range: " << v << std::endl;
+}
+
 bool FTDIDevice::detect(void) {
 
    printDebug("FTDIDevice::detect start", 1);
@@ -179,26 +204,176 @@ bool FTDIDevice::detect(void) {
    return found;
 }
 
-void FTDIDevice::readBytes(unsigned int len, unsigned char *buf) {
-   
-   int read, to_read, last_read;
-   to_read = len;
-   read = 0;
-   
-   last_read = ftdi_read_data(ftdi, buf, to_read);
-   if (last_read > 0)
-      read += last_read;
-
-   while (read < to_read) {
-      last_read = ftdi_read_data(ftdi, buf + read, to_read - read);
-      if (last_read > 0)
-         read += last_read;
-   } 
+// record a TDI[] byte copied in a command template, merging contiguous slots
+static inline void addPatch(std::vector<tdi_patch> *patches, int offset, int tdi) {
+
+   if (patches == nullptr)
+      return;
+
+   if (!patches->empty() && (patches->back().offset + patches->back().len == offset) &&
+      (patches->back().tdi + patches->back().len == tdi))
+      patches->back().len++;
+   else
+      patches->push_back({offset, tdi, 1});
+}
+
+// build the MPSSE command list of a chunk, from current position of TMS[] TDI[] buffer
+// TDI[] slots of the commands are recorded in patches (if not null)
+void FTDIDevice::encodeChunk(chunk_t *c, unsigned char *buffer, int nr_bytes, int &cur_byte_pos, int &left, std::vector<tdi_patch> *patches) {
+
+   int rd_len = 0;
+   int wr_ptr = 0;
+   int desc_pos = 0;
+   int in_cmd_building = 0;
+   int last_len = 0;
+   int cur_len = 0;
+
+   // loop until we may add a command to the current set
+   while ((desc_pos < (chunkSize - 8)) && // we may generate up to 9 descriptors in a single iteration
+      (wr_ptr < (chunkSize - 25)) &&  // we may generate up to 24 command bytes in a single iteration
+      (left > 0)) {
+
+      // buffer => TMS[] TDI[]
+      // no TMS and at least 1 byte to transmit
+      // TMS[] = 0 means no TMS, TMS line must be low before using data shift commands
+      if ((left > 7) && (buffer[cur_byte_pos] == 0) && !tmsHigh) {
+
+         if (in_cmd_building == 0) {
+
+            in_cmd_building = 1;
+            c->cmd[wr_ptr++] = MPSSE_DO_WRITE | MPSSE_DO_READ | MPSSE_LSB | MPSSE_WRITE_NEG | samplingEdge;
+            // 0x10 + 0x20 + 0x08 + 0x01        = 0x39       without MPSSE_READ_NEG
+            // 0x10 + 0x20 + 0x08 + 0x01 + 0x04 = 0x3D       with MPSSE_READ_NEG
+
+            last_len = wr_ptr; // save pointer position, to write the length
+            wr_ptr += 2;       // reserve space for length (byte mode with 2 len)
+            cur_len = -1;      // will be increased when the byte is added
+         }
+
+         addPatch(patches, wr_ptr, cur_byte_pos + nr_bytes);
+         c->cmd[wr_ptr++] = buffer[cur_byte_pos + nr_bytes];     // current element of TDI[]
+         rd_len += 1;      // it generates one byte for reading
+         cur_len += 1;     // update len of current command
+         cur_byte_pos++;   // go to next element of TDI[]
+         left -= 8;        // 8 bits (1 byte) done
+
+      } else {
+
+         // it is no standard (TDI) shift
+         // if we created a standard shift command before we must complete it
+         if (in_cmd_building) { // complete the last command
+
+            c->cmd[last_len] = cur_len & 0xff;
+            c->cmd[last_len + 1] = (cur_len >> 8) & 0xff;
+            in_cmd_building = 0;
+            // add the descriptor to the read descriptors
+            c->desc[desc_pos].oper = 0;         // byte shift
+            c->desc[desc_pos++].len = cur_len;
+         }
+
+         if ((buffer[cur_byte_pos] == 0) && (left <= 7) && !tmsHigh) { // no TMS, bit shift of last bits
+
+            c->cmd[wr_ptr++] = MPSSE_DO_WRITE | MPSSE_DO_READ | MPSSE_LSB | MPSSE_BITMODE | MPSSE_WRITE_NEG | samplingEdge;
+            // 0x10 + 0x20 + 0x08 + 0x02 + 0x01           = 0x3B       without MPSSE_READ_NEG
+            // 0x10 + 0x20 + 0x08 + 0x01 + 0x02 + 0x04    = 0x3F       with MPSSE_READ_NEG
+            c->cmd[wr_ptr++] = left - 1;
+            addPatch(patches, wr_ptr, cur_byte_pos + nr_bytes);
+            c->cmd[wr_ptr++] = buffer[cur_byte_pos + nr_bytes];     // current element of TDI[] 
+            rd_len += 1;
+            cur_byte_pos++;
+            // add the descriptor to the read descriptors
+            c->desc[desc_pos].oper = 1;         // bit shift
+            c->desc[desc_pos++].len = left - 1;
+            left = 0;
+
+         } else { // TMS shift (or TMS line still high), convert it into a set of TMS shifts
+
+            // pack up to 7 TMS bits in a single command while TDI does not change
+            // TDI[] bit is held on TDI line for the whole command (bit 7 of data byte)
+            int i = 0;
+            while ((i < 8) && (left > 0)) { // left could end in this byte
+
+               int tdi = (buffer[cur_byte_pos + nr_bytes] >> i) & 0x01;
+               int len = 0;
+               unsigned char tms = 0;
+
+               while ((len < 7) && (i < 8) && (left > 0) &&
+                  (((buffer[cur_byte_pos + nr_bytes] >> i) & 0x01) == tdi)) {
+                  // buffer[cur_byte_pos] => current element of TMS[]
+                  tms |= ((buffer[cur_byte_pos] >> i) & 0x01) << len;
+                  len++;
+                  i++;
+                  left--;
+               }
+
+               c->cmd[wr_ptr++] = MPSSE_WRITE_TMS | MPSSE_DO_READ | MPSSE_LSB | MPSSE_BITMODE | MPSSE_WRITE_NEG | samplingEdge;
+               // 0x40 + 0x20 + 0x08 + 0x02 + 0x01         = 0x6B
+               // 0x40 + 0x20 + 0x08 + 0x02 + 0x01 + 0x04  = 0x6F
+               c->cmd[wr_ptr++] = len - 1;
+               c->cmd[wr_ptr++] = tms | (tdi ? 0x80 : 0x00);
+               tmsHigh = (tms >> (len - 1)) & 0x01;
+               rd_len += 1;
+               // add the descriptor to the read descriptors
+               c->desc[desc_pos].oper = 2;          // TMS bit shift
+               c->desc[desc_pos++].len = len - 1;
+            } // end while
+
+            cur_byte_pos++;
+         }
+
+      } // else
+
+   }   // end while commands
+
+   // we must complete the last command if it has not been completed yet
+   // the code below should be the same, as in the loop!
+   if (in_cmd_building) { // complete the last command
+
+      c->cmd[last_len] = cur_len & 0xff;
+      c->cmd[last_len + 1] = (cur_len >> 8) & 0xff;
+      in_cmd_building = 0;
+      // add the descriptor to the read descriptors
+      c->desc[desc_pos].oper = 0;         // byte shift
+      c->desc[desc_pos++].len = cur_len;
+   }
+
+   c->wr_len = wr_ptr;
+   c->rd_len = rd_len;
+   c->desc_len = desc_pos;
+}
+
+// append TDO bits of a completed chunk to result
+void FTDIDevice::decodeChunk(chunk_t *c, unsigned char *result, int &bit_pos) {
+
+   // unpack the response basing on the read descriptors
+   // please note, that the responses do not always come as full bits!
+   int rd_byte_pos = 0;
+
+   for (int i = 0; i < c->desc_len; i++) {
+
+      // reading depends on the type of command
+      switch (c->rddesc[i].oper) {
+
+         case 0: // standard shift
+            bitCopy(result, bit_pos, c->res + rd_byte_pos, 0, (c->rddesc[i].len + 1) * 8);
+            bit_pos += (c->rddesc[i].len + 1) * 8;
+            rd_byte_pos += c->rddesc[i].len + 1;
+         break;
+         case 1: // bit shift
+         case 2: // TMS shift
+            // received bits are shifted from the MSB!
+            bitPut(result, bit_pos, c->res[rd_byte_pos] >> (7 - c->rddesc[i].len), c->rddesc[i].len + 1);
+            bit_pos += c->rddesc[i].len + 1;
+            rd_byte_pos++;
+         break;
+
+      } // end switch
+
+   } // end for
 }
 
 void FTDIDevice::shift(int nbits, unsigned char *buffer, unsigned char *result) {
 
-   int i;
    int nr_bytes;
    int cur_byte_pos = 0;
    int bit_pos = 0;
@@ -207,165 +382,180 @@ void FTDIDevice::shift(int nbits, unsigned char *buffer, unsigned char *result)
    // buffer length is (nr_bytes * 2)
    nr_bytes = (nbits + 7) / 8;
    left = nbits;
-   unsigned char ftdi_cmd[MAX_DATA];
-   unsigned char ftdi_res[MAX_DATA];
-   data_desc ftdi_desc[MAX_DATA];
+
+   trackTMS(nbits, buffer, buffer + (nbits + 7) / 8);
+
+   int head = 0;        // oldest chunk in flight
+   int inflight = 0;    // chunks submitted and not yet decoded
+   bool failed = false;
+
+   // repeated TMS patterns replay a compiled plan, new ones are recorded while encoded
+   int mode = samplingEdge | (tmsHigh ? PLAN_TMS_HIGH : 0x00);
+   shift_plan *plan = planCache.lookup(nbits, mode, buffer);
+   shift_plan newPlan;
+   bool record = (plan == nullptr) && planCache.isEnabled();
+   unsigned int next = 0;  // next plan chunk
+
+   if (record)
+      planCache.initPlan(newPlan, nbits, mode, buffer);
+
+   auto more = [&]() { return plan ? (next < plan->chunks.size()) : (left > 0); };
 
    // prepare the result buffer (TDO)
    memset(result, 0, nr_bytes);
 
-   // loop until there are data to handle
-   while (left) {
+   // keep up to transferDepth chunks in flight: while the reply of the oldest chunk
+   // is read the next chunks are encoded and written; the device serves commands in order
+   while ((more() || inflight) && !failed) {
 
-      int rd_len = 0;
-      int wr_ptr = 0;
-      int desc_pos = 0;
-      int in_cmd_building = 0;
-      int last_len = 0;
-      int cur_len = 0;
+      while (more() && (inflight < transferDepth)) {
 
-      // loop until we may add a command to the current set
-      while ((desc_pos < (MAX_DATA - 8)) && // we may generate up to 9 descriptors in a single iteration
-         (wr_ptr < (MAX_DATA - 25)) &&  // we may generate up to 24 command bytes in a single iteration
-         (left > 0)) {
+         chunk_t *c = &chunks[(head + inflight) % transferDepth];
 
-         // buffer => TMS[] TDI[]
-         // no TMS and at least 1 byte to transmit
-         // TMS[] = 0 means no TMS
-         if ((left > 7) && (buffer[cur_byte_pos] == 0)) {
+         if (plan) {
 
-            if (in_cmd_building == 0) {
+            plan_chunk *pc = &plan->chunks[next++];
 
-               in_cmd_building = 1;
-               ftdi_cmd[wr_ptr++] = MPSSE_DO_WRITE | MPSSE_DO_READ | MPSSE_LSB | MPSSE_WRITE_NEG | samplingEdge;
-               // 0x10 + 0x20 + 0x08 + 0x01        = 0x39       without MPSSE_READ_NEG
-               // 0x10 + 0x20 + 0x08 + 0x01 + 0x04 = 0x3D       with MPSSE_READ_NEG
+            // patch TDI[] bytes into command template
+            for (unsigned int i = 0; i < pc->patches.size(); i++)
+               memcpy(pc->cmd.data() + pc->patches[i].offset, buffer + pc->patches[i].tdi, pc->patches[i].len);
 
-               last_len = wr_ptr; // save pointer position, to write the length
-               wr_ptr += 2;       // reserve space for length (byte mode with 2 len)
-               cur_len = -1;      // will be increased when the byte is added
-            }
-
-            ftdi_cmd[wr_ptr++] = buffer[cur_byte_pos + nr_bytes];     // current element of TDI[]
-            rd_len += 1;      // it generates one byte for reading
-            cur_len += 1;     // update len of current command
-            cur_byte_pos++;   // go to next element of TDI[]
-            left -= 8;        // 8 bits (1 byte) done
+            c->wrbuf = pc->cmd.data();
+            c->rddesc = pc->desc.data();
+            c->wr_len = pc->cmd.size();
+            c->rd_len = pc->rd_len;
+            c->desc_len = pc->desc.size();
 
          } else {
 
-            // it is no standard (TDI) shift
-            // if we created a standard shift command before we must complete it
-            if (in_cmd_building) { // complete the last command
+            plan_chunk pc;
 
-               ftdi_cmd[last_len] = cur_len & 0xff;
-               ftdi_cmd[last_len + 1] = (cur_len >> 8) & 0xff;
-               in_cmd_building = 0;
-               // add the descriptor to the read descriptors
-               ftdi_desc[desc_pos].oper = 0;         // byte shift
-               ftdi_desc[desc_pos++].len = cur_len;
+            encodeChunk(c, buffer, nr_bytes, cur_byte_pos, left, record ? &pc.patches : nullptr);
+            c->wrbuf = c->cmd;
+            c->rddesc = c->desc;
+
+            if (record) {
+               pc.cmd.assign(c->cmd, c->cmd + c->wr_len);
+               pc.desc.assign(c->desc, c->desc + c->desc_len);
+               pc.rd_len = c->rd_len;
+               newPlan.chunks.push_back(std::move(pc));
             }
+         }
 
-            if ((buffer[cur_byte_pos] == 0) && (left <= 7)) { // no TMS, bit shift of last bits
+         // send the created command list
+         c->wrxfer = port->submitWrite(c->wrbuf, c->wr_len);
+         c->rdxfer = nullptr;
 
-               ftdi_cmd[wr_ptr++] = MPSSE_DO_WRITE | MPSSE_DO_READ | MPSSE_LSB | MPSSE_BITMODE | MPSSE_WRITE_NEG | samplingEdge;
-               // 0x10 + 0x20 + 0x08 + 0x02 + 0x01           = 0x3B       without MPSSE_READ_NEG
-               // 0x10 + 0x20 + 0x08 + 0x01 + 0x02 + 0x04    = 0x3F       with MPSSE_READ_NEG
-               ftdi_cmd[wr_ptr++] = left - 1;
-               ftdi_cmd[wr_ptr++] = buffer[cur_byte_pos + nr_bytes];     // current element of TDI[] 
-               rd_len += 1;
-               cur_byte_pos++;
-               // add the descriptor to the read descriptors
-               ftdi_desc[desc_pos].oper = 1;         // bit shift
-               ftdi_desc[desc_pos++].len = left - 1;
-               left = 0;
+         // ports allow a single read in flight: only the oldest chunk reads
+         if (inflight == 0)
+            c->rdxfer = port->submitRead(c->res, c->rd_len);
+
+         inflight++;
+      }
 
-            } else if (buffer[cur_byte_pos] != 0) { // TMS shift, convert it into a set of TMS shifts
+      chunk_t *c = &chunks[head];
 
-               int i;
-               for (i = 0; i < 8; i++) {
+      // read the response
+      if ((c->wrxfer == nullptr) || (port->wait(c->wrxfer, USB_TIMEOUT) != c->wr_len))
+         failed = true;
 
-                  if (left == 0)
-                     break; // this could be the last byte!
+      if (c->rdxfer == nullptr)
+         failed = true;
+      else if (failed)
+         port->cancel(c->rdxfer);
+      else if (port->wait(c->rdxfer, USB_TIMEOUT) != c->rd_len)
+         failed = true;
 
-                  ftdi_cmd[wr_ptr++] = MPSSE_WRITE_TMS | MPSSE_DO_READ | MPSSE_LSB | MPSSE_BITMODE | MPSSE_WRITE_NEG | samplingEdge;
-                  // 0x40 + 0x20 + 0x08 + 0x02 + 0x01         = 0x6B
-                  // 0x40 + 0x20 + 0x08 + 0x02 + 0x01 + 0x04  = 0x6F
-                  ftdi_cmd[wr_ptr++] = 0; // one bit length
-                  // buffer[cur_byte_pos] => current element of TMS[]
-                  ftdi_cmd[wr_ptr++] =
-                     ((buffer[cur_byte_pos] & (1 << i)) ? 0x01 : 0x00) |             // check TMS[] bit
-                     ((buffer[cur_byte_pos + nr_bytes] & (1 << i)) ? 0x80 : 0x00);   // check correspondent TDI[] bit
-                  left--;
-                  rd_len += 1;
-                  // add the descriptor to the read descriptors
-                  ftdi_desc[desc_pos].oper = 2;    // TMS bit shift
-                  ftdi_desc[desc_pos++].len = 0;   // 1 bit length
-               } // end for
+      head = (head + 1) % transferDepth;
+      inflight--;
 
-               cur_byte_pos++;
-            }
+      if (failed)
+         break;
+
+      // start reading next chunk before decoding this one
+      if (inflight)
+         chunks[head].rdxfer = port->submitRead(chunks[head].res, chunks[head].rd_len);
 
-         } // else
+      decodeChunk(c, result, bit_pos);
 
-      }   // end while commands
+   } // end while
+
+   if (failed) {
 
-      // we must complete the last command if it has not been completed yet
-      // the code below should be the same, as in the loop!
-      if (in_cmd_building) { // complete the last command
+      std::cout << "E: FTDIDevice: USB transfer failed (" << port->getError() << ")" << std::endl;
 
-         ftdi_cmd[last_len] = cur_len & 0xff;
-         ftdi_cmd[last_len + 1] = (cur_len >> 8) & 0xff;
-         in_cmd_building = 0;
-         // add the descriptor to the read descriptors
-         ftdi_desc[desc_pos].oper = 0;         // byte shift
-         ftdi_desc[desc_pos++].len = cur_len;
+      // drop chunks still in flight and stale replies
+      for (int i = 0; i < inflight; i++) {
+         chunk_t *c = &chunks[(head + i) % transferDepth];
+         if (c->wrxfer)
+            port->wait(c->wrxfer, USB_TIMEOUT);
+         if (c->rdxfer)
+            port->cancel(c->rdxfer);
       }
 
-      // send the created command list
-      ftdi_write_data(ftdi, ftdi_cmd, wr_ptr);
+      port->purge();
+   }
 
-      // read the response
-      readBytes(rd_len, ftdi_res);
+   // TMS line is left at the last TMS[] bit (unknown after a failure)
+   if (failed)
+      tmsHigh = true;
+   else if (nbits > 0)
+      tmsHigh = (buffer[(nbits - 1) / 8] >> ((nbits - 1) % 8)) & 0x01;
+
+   if (record && !failed)
+      planCache.insert(newPlan);
+}
 
-      // unpack the response basing on the read descriptors
-      // please note, that the responses do not always come as full bits!
-      int rd_byte_pos = 0;
+// compare TDO and chain state of random shifts with the scalar reference of the SIM backend:
+// lengths are random (odd ones and chunk crossing included), TMS is mostly zero to exercise
+// packed runs and every other shift repeats the last TMS pattern to replay its compiled plan
+bool FTDIDevice::checkEncoder(int rounds) {
 
-      for (i = 0; i < desc_pos; i++) {
+   FTDISimPort *sim = dynamic_cast<FTDISimPort *>(port);
 
-         int j;
+   if(sim == nullptr) {
+      std::cout << "E: encoder check requires SIM backend" << std::endl;
+      return false;
+   }
 
-         // reading depends on the type of command
-         switch (ftdi_desc[i].oper) {
+   std::vector<unsigned char> buffer, result, expected;
+   int nbits = 0, nr_bytes = 0;
+   int bad = 0;
+   long bits = 0;
 
-            case 0: // standard shift
-               for (j = 0; j <= ftdi_desc[i].len; j++) {
-                  int bnr;
-                  for (bnr = 0; bnr < 8; bnr++) {
-                     result[bit_pos / 8] |= (ftdi_res[rd_byte_pos] & (1 << bnr)) ? (1 << (bit_pos & 7)) : 0;
-                     bit_pos++;
-                  }
-                  rd_byte_pos++;
-               }
-            break;
-            case 1: // bit shift
-               int bnr; // received bits are shifted from the MSB!
-               for (bnr = 7 - ftdi_desc[i].len; bnr < 8; bnr++) {
-                  result[bit_pos / 8] |= (ftdi_res[rd_byte_pos] & (1 << bnr)) ? (1 << (bit_pos & 7)) : 0;
-                  bit_pos++;
-               }
-               rd_byte_pos++;
-            break;
-            case 2: // TMS shift
-               result[bit_pos / 8] |= (ftdi_res[rd_byte_pos] & 0x80) ? (1 << (bit_pos & 7)) : 0;
-               bit_pos++;
-               rd_byte_pos++;
-            break;
+   std::srand(1);
 
-         } // end switch
+   for(int i = 0; i < rounds; i++) {
 
-      } // end for
+      bool repeat = (i > 0) && (std::rand() & 1);
 
-   } // end while
-} 
+      if(!repeat) {
+         nbits = 1 + std::rand() % (MAX_DATA * 8);
+         nr_bytes = (nbits + 7) / 8;
+         buffer.assign(nr_bytes * 2, 0);
+         for(int j = 0; j < nr_bytes; j++)
+            buffer[j] = (std::rand() % 4) ? 0x00 : std::rand();
+      }
+
+      for(int j = nr_bytes; j < nr_bytes * 2; j++)
+         buffer[j] = std::rand();
+
+      result.assign(nr_bytes, 0);
+      expected.assign(nr_bytes, 0);
+
+      sim->checkpoint();
+      shift(nbits, buffer.data(), result.data());
+      bool same = sim->referenceShift(nbits, buffer.data(), expected.data());
+
+      if(!same || result != expected) {
+         bad++;
+         printDebug("FTDIDevice: encoder check shift " + std::to_string(i) + " (" + std::to_string(nbits) +
+            " bits" + (repeat ? ", repeated TMS" : "") + ") differs from reference", 1);
+      }
+      bits += nbits;
+   }
+
+   std::cout << "I: encoder check: " << rounds << " shifts, " << bits << " bits, mismatches: " << bad << std::endl;
+
+   return (bad == 0);
+}
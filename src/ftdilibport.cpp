@@ -0,0 +1,122 @@
+#include "ftdilibport.h"
+#include <chrono>
+#include <libusb-1.0/libusb.h>
+
+FTDILibPort::FTDILibPort(int vid, int pid, enum ftdi_interface interface, const char *serial) {
+
+   setName("LIBFTDI");
+
+   if ((ftdi = ftdi_new()) == 0)
+      throw std::runtime_error("E: FTDILibPort failed allocation");
+
+   if(ftdi_set_interface(ftdi, interface) < 0) {
+      std::string errmsg(ftdi_get_error_string(ftdi));
+      ftdi_free(ftdi);
+      throw std::runtime_error("E: FTDILibPort can't set interface (" + errmsg + ")");
+   }
+
+   if (ftdi_usb_open_desc(ftdi, vid, pid, NULL, serial) < 0) {
+      std::string errmsg(ftdi_get_error_string(ftdi));
+      ftdi_free(ftdi);
+      throw std::runtime_error("E: FTDILibPort can't open device (" + errmsg + ")");
+   }
+
+   ftdi->usb_read_timeout = USB_TIMEOUT;
+   ftdi->usb_write_timeout = USB_TIMEOUT;
+}
+
+FTDILibPort::~FTDILibPort() {
+   ftdi_usb_close(ftdi);
+   ftdi_free(ftdi);
+}
+
+int FTDILibPort::reset(void) {
+   return ftdi_usb_reset(ftdi);
+}
+
+int FTDILibPort::purge(void) {
+
+   int res = ftdi_usb_purge_rx_buffer(ftdi);
+   if (res < 0)
+      return res;
+
+   return ftdi_usb_purge_tx_buffer(ftdi);
+}
+
+int FTDILibPort::setLatencyTimer(unsigned char value) {
+   return ftdi_set_latency_timer(ftdi, value);
+}
+
+int FTDILibPort::setChunkSize(int size) {
+
+   int res = ftdi_read_data_set_chunksize(ftdi, size);
+   if (res < 0)
+      return res;
+
+   return ftdi_write_data_set_chunksize(ftdi, size);
+}
+
+int FTDILibPort::setBitmode(unsigned char mask, unsigned char mode) {
+   return ftdi_set_bitmode(ftdi, mask, mode);
+}
+
+std::string FTDILibPort::getSerial(void) {
+
+   struct libusb_device_descriptor desc;
+   unsigned char serial[64];
+
+   if (libusb_get_device_descriptor(libusb_get_device(ftdi->usb_dev), &desc) < 0)
+      return "";
+
+   if (libusb_get_string_descriptor_ascii(ftdi->usb_dev, desc.iSerialNumber, serial, sizeof(serial)) < 0)
+      return "";
+
+   return std::string((char *) serial);
+}
+
+std::string FTDILibPort::getError(void) {
+   return std::string(ftdi_get_error_string(ftdi));
+}
+
+int FTDILibPort::write(unsigned char *buf, int len) {
+   return ftdi_write_data(ftdi, buf, len);
+}
+
+void *FTDILibPort::submitWrite(unsigned char *buf, int len) {
+   return ftdi_write_data_submit(ftdi, buf, len);
+}
+
+// libftdi allows a single read in flight
+void *FTDILibPort::submitRead(unsigned char *buf, int len) {
+   return ftdi_read_data_submit(ftdi, buf, len);
+}
+
+// wait for completion of a submitted transfer, cancel it on timeout
+int FTDILibPort::wait(void *xfer, int timeout) {
+
+   struct ftdi_transfer_control *tc = (struct ftdi_transfer_control *) xfer;
+   std::chrono::steady_clock::time_point deadline = 
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+   while (!tc->completed) {
+
+      long usec = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if (usec <= 0) {
+         ftdi_transfer_data_cancel(tc, NULL);
+         return -1;
+      }
+
+      struct timeval tv = { usec / 1000000, usec % 1000000 };
+      int res = libusb_handle_events_timeout_completed(ftdi->usb_ctx, &tv, &tc->completed);
+      if ((res < 0) && (res != LIBUSB_ERROR_INTERRUPTED)) {
+         ftdi_transfer_data_cancel(tc, NULL);
+         return -1;
+      }
+   }
+
+   return ftdi_transfer_data_done(tc);
+}
+
+void FTDILibPort::cancel(void *xfer) {
+   ftdi_transfer_data_cancel((struct ftdi_transfer_control *) xfer, NULL);
+}
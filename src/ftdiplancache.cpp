@@ -0,0 +1,148 @@
+#include "ftdiplancache.h"
+#include <string.h>
+#include <stdio.h>
+
+void FTDIPlanCache::setMaxSize(size_t max) {
+   maxSize = max;
+   while (curSize > maxSize)
+      evict();
+}
+
+// TDI[] byte is shifted by TMS commands when TMS[] is set or TMS line is still high
+// from previous byte (or from previous shift for the first byte)
+static inline bool heldByTMS(unsigned char *buffer, int i, int mode) {
+   return buffer[i] || ((i == 0) ? (mode & PLAN_TMS_HIGH) : (buffer[i - 1] & 0x80));
+}
+
+// FNV-1a over TMS[] and TDI[] bytes shifted by TMS commands
+uint64_t FTDIPlanCache::hashKey(int nbits, int mode, unsigned char *buffer) {
+
+   int nbytes = (nbits + 7) / 8;
+   uint64_t h = 0xcbf29ce484222325ULL;
+   const uint64_t prime = 0x100000001b3ULL;
+
+   h = (h ^ nbits) * prime;
+   h = (h ^ mode) * prime;
+
+   int i = 0;
+   for (; i + 8 <= nbytes; i += 8) {
+      uint64_t w;
+      memcpy(&w, buffer + i, 8);
+      h = (h ^ w) * prime;
+      // TDI only matters where TMS commands are used
+      if (w || heldByTMS(buffer, i, mode))
+         for (int j = 0; j < 8; j++)
+            if (heldByTMS(buffer, i + j, mode))
+               h = (h ^ buffer[nbytes + i + j]) * prime;
+   }
+
+   for (; i < nbytes; i++) {
+      h = (h ^ buffer[i]) * prime;
+      if (heldByTMS(buffer, i, mode))
+         h = (h ^ buffer[nbytes + i]) * prime;
+   }
+
+   return h;
+}
+
+bool FTDIPlanCache::matchKey(shift_plan &plan, unsigned char *buffer) {
+
+   int nbytes = (plan.nbits + 7) / 8;
+
+   if (memcmp(plan.key.data(), buffer, nbytes) != 0)
+      return false;
+
+   for (int i = 0; i < nbytes; i++)
+      if (heldByTMS(buffer, i, plan.mode) && (plan.key[nbytes + i] != buffer[nbytes + i]))
+         return false;
+
+   return true;
+}
+
+shift_plan *FTDIPlanCache::lookup(int nbits, int mode, unsigned char *buffer) {
+
+   if (!isEnabled())
+      return nullptr;
+
+   uint64_t h = hashKey(nbits, mode, buffer);
+   auto it = index.find(h);
+
+   if ((it == index.end()) || (it->second->nbits != nbits) || (it->second->mode != mode) ||
+      !matchKey(*it->second, buffer)) {
+      misses++;
+      return nullptr;
+   }
+
+   // move to front of LRU list
+   plans.splice(plans.begin(), plans, it->second);
+   hits++;
+
+   return &plans.front();
+}
+
+void FTDIPlanCache::initPlan(shift_plan &plan, int nbits, int mode, unsigned char *buffer) {
+
+   int nbytes = (nbits + 7) / 8;
+
+   plan.hash = hashKey(nbits, mode, buffer);
+   plan.nbits = nbits;
+   plan.mode = mode;
+   plan.key.assign(buffer, buffer + 2 * nbytes);
+   for (int i = 0; i < nbytes; i++)
+      if (!heldByTMS(buffer, i, mode))
+         plan.key[nbytes + i] = 0;
+   plan.chunks.clear();
+   plan.size = 0;
+}
+
+void FTDIPlanCache::insert(shift_plan &plan) {
+
+   plan.size = sizeof(shift_plan) + plan.key.size();
+   for (unsigned int i = 0; i < plan.chunks.size(); i++)
+      plan.size += sizeof(plan_chunk) + plan.chunks[i].cmd.size() +
+         plan.chunks[i].desc.size() * sizeof(data_desc) + plan.chunks[i].patches.size() * sizeof(tdi_patch);
+
+   // large plans would flush the whole cache
+   if (plan.size > maxSize / 4)
+      return;
+
+   auto it = index.find(plan.hash);
+   if (it != index.end()) {
+      curSize -= it->second->size;
+      plans.erase(it->second);
+      index.erase(it);
+   }
+
+   while (curSize + plan.size > maxSize)
+      evict();
+
+   plans.push_front(std::move(plan));
+   index[plans.front().hash] = plans.begin();
+   curSize += plans.front().size;
+}
+
+void FTDIPlanCache::evict(void) {
+
+   if (plans.empty())
+      return;
+
+   curSize -= plans.back().size;
+   index.erase(plans.back().hash);
+   plans.pop_back();
+   evictions++;
+}
+
+void FTDIPlanCache::clear(void) {
+   plans.clear();
+   index.clear();
+   curSize = 0;
+}
+
+void FTDIPlanCache::printStats(void) {
+
+   unsigned long total = hits + misses;
+
+   printf("FTDIPlanCache: plans: %lu size: %lu/%lu bytes hits: %lu misses: %lu evictions: %lu hit rate: %.1f%%\n",
+      (unsigned long) plans.size(), (unsigned long) curSize, (unsigned long) maxSize,
+      hits, misses, evictions, total ? (100.0 * hits / total) : 0.0);
+}
@@ -7,6 +7,22 @@ void FTDISetup::addItem(FTDICalibItem &item) {
    calibList.push_back(item);
 }
 
+FTDICalibItem * FTDISetup::getItemByIndex(unsigned int index) {
+   if (index >= calibList.size())
+      return nullptr;
+
+   return &calibList[index];
+}
+
+void FTDISetup::delItemById(int id) {
+   for(unsigned int i=0; i<calibList.size(); i++) {
+      if (calibList[i].getId() == id) {
+         calibList.erase(calibList.begin() + i);
+         break;
+      }
+   }
+}
+
 void FTDISetup::clear(void) {
    calibList.clear();
 }
@@ -22,12 +38,13 @@ void FTDISetup::finalize(void) {
 
 bool FTDISetup::loadFile(std::string filename) {
    
-   char id[64], clkDiv[64], tdoSam[64], clkFreq[64];
+   char id[64], clkDiv[64], tdoSam[64], clkFreq[64], clkDiv5[64], margin[64];
 
    fp = fopen(filename.c_str(),"rt");
    if(fp) {
 
       clear();
+      meta.clear();
       while(!feof(fp)) {
 
          int i;
@@ -37,16 +54,26 @@ bool FTDISetup::loadFile(std::string filename) {
          while (i > 0 && isspace(buffer[i-1]))
             i--;
          buffer[i] = 0;
-         if(buffer[0] == '#')
+         if(buffer[0] == '#') {
+            char *eq = strchr(buffer, '=');
+            if(eq && !strchr(buffer, ' ')) {
+               *eq = 0;
+               meta[buffer + 1] = eq + 1;
+            }
             continue;
-         if (sscanf(buffer,"%64s %64s %64s %64s", 
-                     id, clkDiv, tdoSam, clkFreq) == 4) {
+         }
+         // div5 and margin columns are missing in files of previous versions
+         int n = sscanf(buffer,"%63s %63s %63s %63s %63s %63s",
+                     id, clkDiv, tdoSam, clkFreq, clkDiv5, margin);
+         if (n >= 4) {
 
             FTDICalibItem item;
             item.setId(atoi(id));
             item.setClockDivisor(atoi(clkDiv));
             item.setTDOSampling(atoi(tdoSam));
             item.setClockFrequency(atoi(clkFreq));
+            item.setClockDiv5((n >= 5) ? atoi(clkDiv5) : false);
+            item.setMargin((n == 6) ? atoi(margin) : -1);
             addItem(item);
          }
       }
@@ -63,12 +90,17 @@ bool FTDISetup::saveFile(std::string filename) {
    fp = fopen(filename.c_str(),"wt");
    if(fp) {
 
-      fprintf(fp, "%-10s%10s%10s%10s\n", "#id", "divisor", "pedge", "frequency");
+      std::map<std::string, std::string>::iterator m;
+      for(m=meta.begin(); m!=meta.end(); m++)
+         fprintf(fp, "#%s=%s\n", m->first.c_str(), m->second.c_str());
+
+      fprintf(fp, "%-10s%10s%10s%10s%10s%10s\n", "#id", "divisor", "pedge", "frequency", "div5", "margin");
 
       std::vector<FTDICalibItem>::iterator it;
       for(it=calibList.begin(); it!=calibList.end(); it++)
-         fprintf(fp, "%-10d%10d%10d%10d\n",
-               it->getId(), it->getClockDivisor(), it->getTDOSampling(), it->getClockFrequency());
+         fprintf(fp, "%-10d%10d%10d%10d%10d%10d\n",
+               it->getId(), it->getClockDivisor(), it->getTDOSampling(), it->getClockFrequency(), it->getClockDiv5(),
+               it->getMargin());
 
       fclose(fp);
       return true;
@@ -0,0 +1,422 @@
+#include "ftdisimport.h"
+#include "devicedb.h"
+#include <sstream>
+#include <string.h>
+
+// TAP controller states
+enum { TLR, RTI, SELDR, CAPDR, SHDR, EX1DR, PDR, EX2DR, UPDR, SELIR, CAPIR, SHIR, EX1IR, PIR, EX2IR, UPIR };
+
+// next TAP state indexed by current state and TMS
+static const int tapNext[16][2] = {
+   { RTI, TLR },     // Test-Logic-Reset
+   { RTI, SELDR },   // Run-Test/Idle
+   { CAPDR, SELIR }, // Select-DR-Scan
+   { SHDR, EX1DR },  // Capture-DR
+   { SHDR, EX1DR },  // Shift-DR
+   { PDR, UPDR },    // Exit1-DR
+   { PDR, EX2DR },   // Pause-DR
+   { SHDR, UPDR },   // Exit2-DR
+   { RTI, SELDR },   // Update-DR
+   { CAPIR, TLR },   // Select-IR-Scan
+   { SHIR, EX1IR },  // Capture-IR
+   { SHIR, EX1IR },  // Shift-IR
+   { PIR, UPIR },    // Exit1-IR
+   { PIR, EX2IR },   // Pause-IR
+   { SHIR, UPIR },   // Exit2-IR
+   { RTI, SELDR }    // Update-IR
+};
+
+// submitted transfer, writes are executed on submission
+typedef struct {
+   unsigned char *buf;
+   int len;
+   bool read;
+} sim_xfer;
+
+FTDISimPort::FTDISimPort(const char *ids) {
+
+   setName("SIM");
+
+   DeviceDB devDB(0);
+   std::stringstream ss(ids ? ids : "0x0362D093");
+   std::string tmp;
+
+   while(std::getline(ss, tmp, ',')) {
+
+      sim_device dev = {};
+
+      try {
+         dev.idcode = std::stoul(tmp, nullptr, 16);
+      } catch (const std::exception& e) {
+         throw std::runtime_error("E: FTDISimPort invalid IDCODE " + tmp);
+      }
+
+      if(devDB.idToDescription(dev.idcode) == nullptr)
+         throw std::runtime_error("E: FTDISimPort IDCODE " + tmp + " not found in device database");
+
+      dev.irlen = devDB.idToIRLength(dev.idcode);
+      dev.idcmd = devDB.idToIDCmd(dev.idcode);
+      chain.push_back(dev);
+   }
+
+   if(chain.empty())
+      throw std::runtime_error("E: FTDISimPort empty JTAG chain");
+
+   resetChain();
+}
+
+FTDISimPort::~FTDISimPort() {
+   printStats();
+}
+
+void FTDISimPort::printStats(void) {
+
+   std::cout << "FTDISimPort: usb out: " << bytesOut << " bytes, usb in: " << bytesIn <<
+      " bytes, transfers: " << transfers << ", TCK: " << tcks <<
+      ", wire time: " << wireTime * 1000 << " ms" << std::endl;
+}
+
+void FTDISimPort::checkpoint(void) {
+   savedChain = chain;
+   savedState = state;
+}
+
+// buffer holds TMS bytes followed by TDI bytes as in FTDIDevice::shift, TDO goes to result
+bool FTDISimPort::referenceShift(int nbits, unsigned char *buffer, unsigned char *result) {
+
+   std::vector<sim_device> after = chain;
+   int afterState = state;
+   uint64_t t = tcks;
+   double w = wireTime;
+   bool lb = loopback;
+   int nr_bytes = (nbits + 7) / 8;
+
+   chain = savedChain;
+   state = savedState;
+   memset(result, 0, nr_bytes);
+
+   for (int i = 0; i < nbits; i++) {
+      int tms = (buffer[i / 8] >> (i % 8)) & 1;
+      int tdi = (buffer[nr_bytes + i / 8] >> (i % 8)) & 1;
+      result[i / 8] |= clock(tms, tdi) << (i % 8);
+   }
+
+   bool same = (state == afterState);
+   for (unsigned int i = 0; i < chain.size(); i++)
+      same = same && (chain[i].ir == after[i].ir) && (chain[i].irsh == after[i].irsh) &&
+         (chain[i].dr == after[i].dr) && (chain[i].drlen == after[i].drlen);
+
+   // reference clocks are not accounted
+   chain = after;
+   state = afterState;
+   tcks = t;
+   wireTime = w;
+   loopback = lb;
+
+   return same;
+}
+
+// Test-Logic-Reset selects IDCODE (or BYPASS) on every device
+void FTDISimPort::resetChain(void) {
+
+   state = TLR;
+   for (unsigned int i = 0; i < chain.size(); i++)
+      chain[i].ir = chain[i].idcmd;
+}
+
+// one TCK cycle on the chain, returns TDO
+// TDI enters the last device, TDO comes from the first one
+int FTDISimPort::clock(int tms, int tdi) {
+
+   int tdo = tdi;
+
+   if (state == SHDR || state == SHIR) {
+      for (int i = chain.size() - 1; i >= 0; i--) {
+         sim_device &d = chain[i];
+         int out;
+         if (state == SHDR) {
+            out = d.dr & 1;
+            d.dr = (d.dr >> 1) | ((uint64_t) tdo << (d.drlen - 1));
+         } else {
+            out = d.irsh & 1;
+            d.irsh = (d.irsh >> 1) | ((uint64_t) tdo << (d.irlen - 1));
+         }
+         tdo = out;
+      }
+   } else tdo = 0;
+
+   state = tapNext[state][tms & 1];
+
+   switch (state) {
+      case TLR:
+         resetChain();
+         break;
+      case CAPDR:
+         // IDCODE instruction selects 32 bit IDCODE register, other instructions BYPASS
+         for (unsigned int i = 0; i < chain.size(); i++) {
+            sim_device &d = chain[i];
+            d.drlen = (d.ir == d.idcmd) ? 32 : 1;
+            d.dr = (d.ir == d.idcmd) ? d.idcode : 0;
+         }
+         break;
+      case CAPIR:
+         for (unsigned int i = 0; i < chain.size(); i++)
+            chain[i].irsh = 0x01;
+         break;
+      case UPIR:
+         for (unsigned int i = 0; i < chain.size(); i++)
+            chain[i].ir = chain[i].irsh;
+         break;
+   }
+
+   tcks++;
+   wireTime += ((divisor + 1) * 2) / (div5 ? 12E6 : 60E6);
+
+   return loopback ? tdi : tdo;
+}
+
+// length of the command at cmd, -1 if more bytes are needed
+int FTDISimPort::commandLength(unsigned char *cmd, int len) {
+
+   unsigned char op = cmd[0];
+   int n;
+
+   if (op & 0x80) {
+      switch (op) {
+         case SET_BITS_LOW: case SET_BITS_HIGH: case TCK_DIVISOR:
+         case 0x8F: case 0x9C: case 0x9D: case 0x9E:
+            n = 3;
+            break;
+         case 0x8E:
+            n = 2;
+            break;
+         default:
+            n = 1;
+      }
+   } else if (op & MPSSE_WRITE_TMS)
+      n = 3;
+   else if (op & MPSSE_BITMODE)
+      n = (op & MPSSE_DO_WRITE) ? 3 : 2;
+   else if (op & (MPSSE_DO_WRITE | MPSSE_DO_READ)) {
+      if (len < 3)
+         return -1;
+      n = 3 + ((op & MPSSE_DO_WRITE) ? (cmd[1] | (cmd[2] << 8)) + 1 : 0);
+   } else
+      n = 1;
+
+   return (n <= len) ? n : -1;
+}
+
+// interpret a single MPSSE command
+void FTDISimPort::execute(unsigned char *cmd) {
+
+   unsigned char op = cmd[0];
+   int tms = (lowPins >> 3) & 1;
+   int tdi = (lowPins >> 1) & 1;
+
+   if (op & 0x80) {
+
+      switch (op) {
+         case SET_BITS_LOW:
+            lowPins = cmd[1];
+            lowDir = cmd[2];
+            break;
+         case SET_BITS_HIGH:
+            highPins = cmd[1];
+            highDir = cmd[2];
+            break;
+         case GET_BITS_LOW:
+            replies.push_back(lowPins);
+            break;
+         case GET_BITS_HIGH:
+            replies.push_back(highPins);
+            break;
+         case LOOPBACK_START:
+            loopback = true;
+            break;
+         case LOOPBACK_END:
+            loopback = false;
+            break;
+         case TCK_DIVISOR:
+            divisor = cmd[1] | (cmd[2] << 8);
+            break;
+         case DIS_DIV_5:
+            div5 = false;
+            break;
+         case EN_DIV_5:
+            div5 = true;
+            break;
+         case SEND_IMMEDIATE: case 0x8C: case 0x8D: case 0x96: case 0x97:
+            break;
+         case 0x8E:     // clock bits, no data
+            for (int i = 0; i <= cmd[1]; i++)
+               clock(tms, tdi);
+            break;
+         case 0x8F:     // clock bytes, no data
+            for (int i = 0; i <= (cmd[1] | (cmd[2] << 8)) * 8 + 7; i++)
+               clock(tms, tdi);
+            break;
+         case 0x9C: case 0x9D: case 0x9E:
+            break;
+         default:
+            // bad command: echo opcode as the chip does
+            replies.push_back(0xFA);
+            replies.push_back(op);
+      }
+      return;
+   }
+
+   // data shifts keep TMS line at its last level
+   bool lsb = op & MPSSE_LSB;
+   bool rd = op & MPSSE_DO_READ;
+
+   if (op & MPSSE_WRITE_TMS) {
+
+      // TMS bits from LSB, TDI held at bit 7
+      unsigned char res = 0;
+      tdi = (cmd[2] >> 7) & 1;
+      for (int i = 0; i <= cmd[1]; i++) {
+         tms = (cmd[2] >> i) & 1;
+         res = (res >> 1) | (clock(tms, tdi) << 7);
+      }
+      if (rd)
+         replies.push_back(res);
+
+      // TMS and TDI lines hold the last level
+      lowPins = (lowPins & ~0x0A) | (tms << 3) | (tdi << 1);
+
+   } else if (op & MPSSE_BITMODE) {
+
+      // bits are read into MSB (LSB first) or LSB (MSB first) of the reply
+      unsigned char data = (op & MPSSE_DO_WRITE) ? cmd[2] : 0;
+      unsigned char res = 0;
+      for (int i = 0; i <= cmd[1]; i++) {
+         tdi = lsb ? (data >> i) & 1 : (data >> (7 - i)) & 1;
+         int tdo = clock(tms, tdi);
+         res = lsb ? (res >> 1) | (tdo << 7) : (res << 1) | tdo;
+      }
+      if (rd)
+         replies.push_back(res);
+
+      lowPins = (lowPins & ~0x02) | (tdi << 1);
+
+   } else {
+
+      int len = (cmd[1] | (cmd[2] << 8)) + 1;
+      for (int i = 0; i < len; i++) {
+         unsigned char data = (op & MPSSE_DO_WRITE) ? cmd[3 + i] : 0;
+         unsigned char res = 0;
+         for (int j = 0; j < 8; j++) {
+            tdi = lsb ? (data >> j) & 1 : (data >> (7 - j)) & 1;
+            int tdo = clock(tms, tdi);
+            res |= lsb ? (tdo << j) : (tdo << (7 - j));
+         }
+         if (rd)
+            replies.push_back(res);
+      }
+
+      lowPins = (lowPins & ~0x02) | (tdi << 1);
+   }
+}
+
+// run complete commands, a command split across writes waits for its tail
+int FTDISimPort::process(unsigned char *buf, int len) {
+
+   if (!mpsse) {
+      error = "MPSSE mode not enabled";
+      return -1;
+   }
+
+   bytesOut += len;
+   transfers++;
+
+   pending.insert(pending.end(), buf, buf + len);
+
+   unsigned int pos = 0;
+   int n;
+   while (pos < pending.size() && (n = commandLength(pending.data() + pos, pending.size() - pos)) > 0) {
+      execute(pending.data() + pos);
+      pos += n;
+   }
+   pending.erase(pending.begin(), pending.begin() + pos);
+
+   return len;
+}
+
+int FTDISimPort::read(unsigned char *buf, int len) {
+
+   if ((int) replies.size() < len) {
+      error = "read timeout";
+      return -1;
+   }
+
+   std::copy(replies.begin(), replies.begin() + len, buf);
+   replies.erase(replies.begin(), replies.begin() + len);
+   bytesIn += len;
+   transfers++;
+
+   return len;
+}
+
+int FTDISimPort::reset(void) {
+   mpsse = false;
+   loopback = false;
+   return purge();
+}
+
+int FTDISimPort::purge(void) {
+   pending.clear();
+   replies.clear();
+   return 0;
+}
+
+int FTDISimPort::setLatencyTimer(unsigned char value) {
+   return 0;
+}
+
+int FTDISimPort::setChunkSize(int size) {
+   return 0;
+}
+
+int FTDISimPort::setBitmode(unsigned char mask, unsigned char mode) {
+   mpsse = (mode == BITMODE_MPSSE);
+   return 0;
+}
+
+std::string FTDISimPort::getSerial(void) {
+   return "SIM";
+}
+
+std::string FTDISimPort::getError(void) {
+   return error;
+}
+
+int FTDISimPort::write(unsigned char *buf, int len) {
+   return process(buf, len);
+}
+
+void *FTDISimPort::submitWrite(unsigned char *buf, int len) {
+
+   if (process(buf, len) < 0)
+      return nullptr;
+
+   return new sim_xfer { buf, len, false };
+}
+
+void *FTDISimPort::submitRead(unsigned char *buf, int len) {
+   return new sim_xfer { buf, len, true };
+}
+
+// commands are executed on submission: replies of written commands are always available
+int FTDISimPort::wait(void *xfer, int timeout) {
+
+   sim_xfer *x = (sim_xfer *) xfer;
+   int res = x->read ? read(x->buf, x->len) : x->len;
+
+   delete x;
+   return res;
+}
+
+void FTDISimPort::cancel(void *xfer) {
+   delete (sim_xfer *) xfer;
+}
@@ -0,0 +1,207 @@
+#include "ftdituner.h"
+#include <chrono>
+#include <string.h>
+
+#define TUNE_RTT_LOOPS     50
+#define TUNE_BULK_BITS     (256 * 1024)      // 32 kB of TDI
+#define TUNE_BULK_LOOPS    4
+
+static const int chunkSizes[] = { 512, 1024, 2048, 4096 };
+static const int latencies[] = { 1, 2, 4, 8, 16 };
+
+FTDITuner::FTDITuner(FTDIDevice *d) {
+
+   dev = d;
+   serial = dev->getSerial();
+   if(serial.empty())
+      serial = "none";
+
+   best = { dev->getChunkSize(), dev->getLatencyTimer(), dev->getTransferDepth(), 0, 0 };
+}
+
+void FTDITuner::apply(ftdi_tuning &t) {
+   dev->setChunkSize(t.chunkSize);
+   dev->setLatencyTimer(t.latency);
+   dev->setTransferDepth(t.depth);
+}
+
+// average time of a single byte shift (us)
+double FTDITuner::measureRTT(void) {
+
+   unsigned char buf[2] = { 0x00, 0xA5 };
+   unsigned char res[1];
+
+   auto t0 = std::chrono::steady_clock::now();
+   for(int i=0; i<TUNE_RTT_LOOPS; i++)
+      dev->shift(8, buf, res);
+   auto t1 = std::chrono::steady_clock::now();
+
+   return std::chrono::duration<double, std::micro>(t1 - t0).count() / TUNE_RTT_LOOPS;
+}
+
+// bit/s of bulk bypass shifts, TDO must match the reference stream
+double FTDITuner::measureThroughput(bool &valid) {
+
+   // first shift loads bypass registers with the tail of the pattern
+   dev->shift(TUNE_BULK_BITS, buffer.data(), result.data());
+
+   valid = true;
+   auto t0 = std::chrono::steady_clock::now();
+   for(int i=0; i<TUNE_BULK_LOOPS; i++) {
+      dev->shift(TUNE_BULK_BITS, buffer.data(), result.data());
+      if(memcmp(result.data(), reference.data(), result.size()) != 0)
+         valid = false;
+   }
+   auto t1 = std::chrono::steady_clock::now();
+
+   return ((double) TUNE_BULK_BITS * TUNE_BULK_LOOPS) / std::chrono::duration<double>(t1 - t0).count();
+}
+
+bool FTDITuner::run(void) {
+
+   if(!dev->isDetected()) {
+      std::cout << "E: FTDITuner: JTAG target not detected" << std::endl;
+      return false;
+   }
+
+   std::cout << "I: FTDI transfer tuning started (serial " << serial << ")" << std::endl;
+
+   // TMS[] = 0 keeps SHIFT-DR, TDI[] carries a pattern through bypass registers
+   int nbytes = TUNE_BULK_BITS / 8;
+   buffer.assign(2 * nbytes, 0);
+   for(int i=0; i<nbytes; i++)
+      buffer[nbytes + i] = (i * 0x9D) ^ (i >> 3);
+   result.assign(nbytes, 0);
+   reference.assign(nbytes, 0);
+
+   dev->startBypass();
+
+   // reference TDO with current settings
+   dev->shift(TUNE_BULK_BITS, buffer.data(), result.data());
+   dev->shift(TUNE_BULK_BITS, buffer.data(), reference.data());
+
+   // latency timer only matters for short replies
+   ftdi_tuning t = best;
+   double minRtt = -1;
+   for(int latency : latencies) {
+      t.latency = latency;
+      apply(t);
+      double rtt = measureRTT();
+      if(verbose)
+         printf("FTDITuner: latency %d ms rtt %.1f us\n", latency, rtt);
+      if(minRtt < 0 || rtt < minRtt) {
+         minRtt = rtt;
+         best.latency = latency;
+         best.rtt = rtt;
+      }
+   }
+
+   // chunk size and chunks in flight for bulk shifts
+   t.latency = best.latency;
+   for(int chunkSize : chunkSizes) {
+      for(int depth=1; depth<=MAX_INFLIGHT; depth++) {
+
+         t.chunkSize = chunkSize;
+         t.depth = depth;
+         apply(t);
+
+         bool valid;
+         double tp = measureThroughput(valid);
+         if(!valid) {
+            printf("WARNING: FTDITuner: TDO mismatch with chunk size %d depth %d - skipped\n", chunkSize, depth);
+            continue;
+         }
+
+         if(verbose)
+            printf("FTDITuner: chunk size %d depth %d throughput %.2f Mbit/s\n", chunkSize, depth, tp / 1E6);
+
+         if(tp > best.throughput) {
+            best.chunkSize = chunkSize;
+            best.depth = depth;
+            best.throughput = tp;
+         }
+      }
+   }
+
+   apply(best);
+
+   // back to RUN-TEST/IDLE
+   unsigned char buf[2] = { 0x1F, 0x00 };
+   unsigned char res[1];
+   dev->shift(6, buf, res);
+
+   if(best.throughput == 0) {
+      std::cout << "E: FTDITuner: no valid transfer setting found" << std::endl;
+      return false;
+   }
+
+   printf("I: FTDI tuning: chunk size %d latency %d ms depth %d (rtt %.1f us, throughput %.2f Mbit/s)\n",
+      best.chunkSize, best.latency, best.depth, best.rtt, best.throughput / 1E6);
+
+   return true;
+}
+
+// apply stored setting of this adapter
+bool FTDITuner::loadFile(std::string filename) {
+
+   FILE *fp = fopen(filename.c_str(), "rt");
+   if(fp == nullptr)
+      return false;
+
+   bool found = false;
+   char buffer[256], sn[64];
+   ftdi_tuning t = best;
+
+   while(fgets(buffer, sizeof(buffer), fp)) {
+
+      if(buffer[0] == '#')
+         continue;
+
+      if(sscanf(buffer, "%63s %d %d %d %lf %lf", sn, &t.chunkSize, &t.latency, &t.depth, &t.rtt, &t.throughput) == 6 &&
+         serial == sn) {
+         found = true;
+         break;
+      }
+   }
+
+   fclose(fp);
+
+   if(found) {
+      best = t;
+      apply(best);
+      printf("I: FTDI tuning loaded: chunk size %d latency %d ms depth %d\n", best.chunkSize, best.latency, best.depth);
+   }
+
+   return found;
+}
+
+// store setting of this adapter, entries of other adapters are kept
+bool FTDITuner::saveFile(std::string filename) {
+
+   std::vector<std::string> entries;
+   char buffer[256], sn[64];
+
+   FILE *fp = fopen(filename.c_str(), "rt");
+   if(fp) {
+      while(fgets(buffer, sizeof(buffer), fp)) {
+         if(buffer[0] == '#')
+            continue;
+         if(sscanf(buffer, "%63s", sn) == 1 && serial != sn)
+            entries.push_back(buffer);
+      }
+      fclose(fp);
+   }
+
+   fp = fopen(filename.c_str(), "wt");
+   if(fp == nullptr)
+      return false;
+
+   fprintf(fp, "%-20s%10s%10s%10s%12s%14s\n", "#serial", "chunk", "latency", "depth", "rtt(us)", "thr(bit/s)");
+   for(unsigned int i=0; i<entries.size(); i++)
+      fputs(entries[i].c_str(), fp);
+   fprintf(fp, "%-20s%10d%10d%10d%12.1f%14.0f\n", serial.c_str(),
+      best.chunkSize, best.latency, best.depth, best.rtt, best.throughput);
+
+   fclose(fp);
+   return true;
+}
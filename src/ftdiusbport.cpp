@@ -0,0 +1,347 @@
+#include "ftdiusbport.h"
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+
+FTDIUsbPort::FTDIUsbPort(int vid, int pid, enum ftdi_interface interface, const char *serial) {
+
+   libusb_device **list;
+   ssize_t ndev;
+   int res;
+
+   setName("LIBUSB");
+
+   // FT2232H/FT4232H channel A:1 B:2 ... uses endpoints 0x02/0x81, 0x04/0x83, ...
+   ifnum = (interface == INTERFACE_ANY) ? 0 : (interface - 1);
+   index = ifnum + 1;
+   inEp = 0x81 + 2 * ifnum;
+   outEp = 0x02 + 2 * ifnum;
+
+   if (libusb_init(&ctx) < 0)
+      throw std::runtime_error("E: FTDIUsbPort libusb initialization failed");
+
+   if ((ndev = libusb_get_device_list(ctx, &list)) < 0) {
+      libusb_exit(ctx);
+      throw std::runtime_error("E: FTDIUsbPort can't get USB device list");
+   }
+
+   for (ssize_t i = 0; i < ndev && handle == nullptr; i++) {
+
+      struct libusb_device_descriptor desc;
+      libusb_device_handle *h;
+      unsigned char sn[64] = {0};
+
+      if (libusb_get_device_descriptor(list[i], &desc) < 0)
+         continue;
+
+      if ((desc.idVendor != vid) || (desc.idProduct != pid))
+         continue;
+
+      if (libusb_open(list[i], &h) < 0)
+         continue;
+
+      if (desc.iSerialNumber)
+         libusb_get_string_descriptor_ascii(h, desc.iSerialNumber, sn, sizeof(sn));
+
+      if ((serial == NULL) || (strcmp(serial, (char *) sn) == 0)) {
+         handle = h;
+         serialNumber = std::string((char *) sn);
+      } else libusb_close(h);
+   }
+
+   libusb_free_device_list(list, 1);
+
+   if (handle == nullptr) {
+      libusb_exit(ctx);
+      throw std::runtime_error("E: FTDIUsbPort can't open device (device not found)");
+   }
+
+   if (libusb_kernel_driver_active(handle, ifnum) == 1)
+      libusb_detach_kernel_driver(handle, ifnum);
+
+   if ((res = libusb_claim_interface(handle, ifnum)) < 0) {
+      libusb_close(handle);
+      libusb_exit(ctx);
+      throw std::runtime_error("E: FTDIUsbPort can't claim interface (" + std::string(libusb_error_name(res)) + ")");
+   }
+
+   if ((res = libusb_get_max_packet_size(libusb_get_device(handle), inEp)) > FTDI_STATUS_BYTES)
+      maxPacket = res;
+   readSize = (USB_READ_SIZE / maxPacket) * maxPacket;
+
+   // pre-allocate transfers
+   for (int i = 0; i < USB_MAX_WRITES; i++) {
+      writes[i].xfer = libusb_alloc_transfer(0);
+      writes[i].port = this;
+      writes[i].busy = false;
+   }
+
+   reads.xfer = libusb_alloc_transfer(0);
+   reads.port = this;
+   reads.busy = false;
+}
+
+FTDIUsbPort::~FTDIUsbPort() {
+
+   for (int i = 0; i < USB_MAX_WRITES; i++) {
+      if (writes[i].busy)
+         cancel(&writes[i]);
+      libusb_free_transfer(writes[i].xfer);
+   }
+
+   if (reads.busy)
+      cancel(&reads);
+   libusb_free_transfer(reads.xfer);
+
+   libusb_release_interface(handle, ifnum);
+   libusb_close(handle);
+   libusb_exit(ctx);
+}
+
+int FTDIUsbPort::control(uint8_t request, uint16_t value) {
+
+   int res = libusb_control_transfer(handle, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE | LIBUSB_ENDPOINT_OUT,
+      request, value, index, NULL, 0, USB_TIMEOUT);
+
+   if (res < 0)
+      error = libusb_error_name(res);
+
+   return res;
+}
+
+int FTDIUsbPort::reset(void) {
+   return control(USB_SIO_RESET, USB_SIO_RESET_SIO);
+}
+
+int FTDIUsbPort::purge(void) {
+
+   int res = control(USB_SIO_RESET, USB_SIO_PURGE_RX);
+   spillLen = 0;
+   if (res < 0)
+      return res;
+
+   return control(USB_SIO_RESET, USB_SIO_PURGE_TX);
+}
+
+int FTDIUsbPort::setLatencyTimer(unsigned char value) {
+   return control(USB_SIO_SET_LATENCY, value);
+}
+
+// IN transfers are limited to the packets carrying size bytes of payload
+int FTDIUsbPort::setChunkSize(int size) {
+
+   int payload = maxPacket - FTDI_STATUS_BYTES;
+   int packets = std::max((size + payload - 1) / payload, 1);
+
+   readSize = std::min(packets * maxPacket, (USB_READ_SIZE / maxPacket) * maxPacket);
+   return 0;
+}
+
+int FTDIUsbPort::setBitmode(unsigned char mask, unsigned char mode) {
+   return control(USB_SIO_SET_BITMODE, mask | (mode << 8));
+}
+
+int FTDIUsbPort::write(unsigned char *buf, int len) {
+
+   int done = 0;
+
+   while (done < len) {
+
+      int n = 0;
+      int res = libusb_bulk_transfer(handle, outEp, buf + done, len - done, &n, USB_TIMEOUT);
+      if (res < 0) {
+         error = libusb_error_name(res);
+         return res;
+      }
+      done += n;
+   }
+
+   return done;
+}
+
+void FTDIUsbPort::writeCallback(struct libusb_transfer *xfer) {
+
+   usb_xfer_t *x = (usb_xfer_t *) xfer->user_data;
+
+   x->done = (xfer->status == LIBUSB_TRANSFER_COMPLETED) ? xfer->actual_length : -1;
+   x->completed = 1;
+}
+
+void *FTDIUsbPort::submitWrite(unsigned char *buf, int len) {
+
+   usb_xfer_t *x = nullptr;
+
+   for (int i = 0; i < USB_MAX_WRITES && x == nullptr; i++)
+      if (!writes[i].busy)
+         x = &writes[i];
+
+   if (x == nullptr) {
+      error = "no free write transfer";
+      return nullptr;
+   }
+
+   x->size = len;
+   x->done = 0;
+   x->completed = 0;
+   x->cancelling = false;
+
+   libusb_fill_bulk_transfer(x->xfer, handle, outEp, buf, len, writeCallback, x, USB_TIMEOUT);
+
+   int res = libusb_submit_transfer(x->xfer);
+   if (res < 0) {
+      error = libusb_error_name(res);
+      return nullptr;
+   }
+
+   x->busy = true;
+   return x;
+}
+
+// request the number of packets needed by the remaining payload, the device
+// never sends more than pending replies so the raw buffer can't overflow
+int FTDIUsbPort::submitReadPackets(void) {
+
+   int payload = maxPacket - FTDI_STATUS_BYTES;
+   int packets = (reads.size - reads.done + payload - 1) / payload;
+   int len = std::min(packets * maxPacket, readSize);
+
+   libusb_fill_bulk_transfer(reads.xfer, handle, inEp, rawbuf, len, readCallback, &reads, USB_TIMEOUT);
+
+   return libusb_submit_transfer(reads.xfer);
+}
+
+// every packet starts with modem status bytes: payload is copied once to the destination
+// of x, replies of next commands already in the packets are kept in spill for next read
+void FTDIUsbPort::unpack(unsigned char *raw, int len, usb_xfer_t *x) {
+
+   for (int pos = 0; pos < len; pos += maxPacket) {
+
+      unsigned char *payload = raw + pos + FTDI_STATUS_BYTES;
+      int n = std::min(maxPacket, len - pos) - FTDI_STATUS_BYTES;
+      int cnt = std::min(n, x->size - x->done);
+
+      if (cnt > 0) {
+         memcpy(x->dst + x->done, payload, cnt);
+         x->done += cnt;
+      }
+
+      if (n > cnt) {
+         int extra = std::min(n - cnt, USB_READ_SIZE - spillLen);
+         memcpy(spill + spillLen, payload + cnt, extra);
+         spillLen += extra;
+      }
+   }
+}
+
+void FTDIUsbPort::readCallback(struct libusb_transfer *xfer) {
+
+   usb_xfer_t *x = (usb_xfer_t *) xfer->user_data;
+   FTDIUsbPort *p = x->port;
+
+   if ((xfer->status == LIBUSB_TRANSFER_COMPLETED) || (xfer->status == LIBUSB_TRANSFER_TIMED_OUT)) {
+
+      p->unpack(xfer->buffer, xfer->actual_length, x);
+
+      // short packets are flushed by latency timer: ask for the rest
+      if ((x->done < x->size) && !x->cancelling && (p->submitReadPackets() == 0))
+         return;
+   }
+
+   x->completed = 1;
+}
+
+// single read in flight
+void *FTDIUsbPort::submitRead(unsigned char *buf, int len) {
+
+   if (reads.busy) {
+      error = "read transfer already in flight";
+      return nullptr;
+   }
+
+   reads.dst = buf;
+   reads.size = len;
+   reads.done = std::min(len, spillLen);
+   reads.completed = 0;
+   reads.cancelling = false;
+   reads.busy = true;
+
+   // serve replies left by previous read
+   if (reads.done) {
+      memcpy(buf, spill, reads.done);
+      spillLen -= reads.done;
+      memmove(spill, spill + reads.done, spillLen);
+   }
+
+   if (reads.done == len) {
+      reads.completed = 1;
+      return &reads;
+   }
+
+   int res = submitReadPackets();
+   if (res < 0) {
+      error = libusb_error_name(res);
+      reads.busy = false;
+      return nullptr;
+   }
+
+   return &reads;
+}
+
+// wait for completion of a submitted transfer, cancel it on timeout
+int FTDIUsbPort::wait(void *xfer, int timeout) {
+
+   usb_xfer_t *x = (usb_xfer_t *) xfer;
+   std::chrono::steady_clock::time_point deadline = 
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+   while (!x->completed) {
+
+      long usec = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if (usec <= 0) {
+         error = "transfer timeout";
+         cancel(x);
+         return -1;
+      }
+
+      struct timeval tv = { usec / 1000000, usec % 1000000 };
+      int res = libusb_handle_events_timeout_completed(ctx, &tv, &x->completed);
+      if ((res < 0) && (res != LIBUSB_ERROR_INTERRUPTED)) {
+         error = libusb_error_name(res);
+         cancel(x);
+         return -1;
+      }
+   }
+
+   x->busy = false;
+   return x->done;
+}
+
+// a completion racing the cancel request may have resubmitted the transfer: it is
+// cancelled again until its callback runs; the port stays busy if it never does
+void FTDIUsbPort::cancel(void *xfer) {
+
+   usb_xfer_t *x = (usb_xfer_t *) xfer;
+   std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(USB_CANCEL_TIMEOUT);
+
+   x->cancelling = true;
+
+   while (!x->completed) {
+
+      if (std::chrono::steady_clock::now() >= deadline) {
+         error = "transfer cancel timeout";
+         return;
+      }
+
+      libusb_cancel_transfer(x->xfer);
+
+      struct timeval tv = { 0, 100000 };
+      int res = libusb_handle_events_timeout_completed(ctx, &tv, &x->completed);
+      if ((res < 0) && (res != LIBUSB_ERROR_INTERRUPTED)) {
+         error = libusb_error_name(res);
+         return;
+      }
+   }
+
+   x->busy = false;
+}
@@ -0,0 +1,86 @@
+#include "idlegate.h"
+#include <unistd.h>
+
+IdleGate::IdleGate(XVCDriver *d, double g) : seq(64) {
+
+   dev = d;
+   gap = g;
+   client = dev->getClockSetting();
+}
+
+void IdleGate::enter(void) {
+
+   if(inside)
+      return;
+
+   while(true) {
+
+      if(dev->isClientWaiting() || dev->getIdleTime() < gap) {
+         usleep(IDLE_POLL);
+         continue;
+      }
+
+      dev->getLock().lock();
+
+      // a client shift may have run meanwhile, a scan in progress is never broken;
+      // in RUN-TEST/IDLE the client instruction must be known to load it again on leave
+      int state = dev->getTapState();
+      if(!dev->isClientWaiting() && dev->getIdleTime() >= gap &&
+         (state == TAP_RESET || state == TAP_UNKNOWN ||
+         (state == TAP_IDLE && dev->getInstruction(clientIr) >= 0)))
+         break;
+
+      dev->getLock().unlock();
+      usleep(IDLE_POLL);
+   }
+
+   clientState = dev->getTapState();
+   clientIrBits = dev->getInstruction(clientIr);
+   if(taskClockSet)
+      dev->setClockSetting(task);
+   inside = true;
+}
+
+void IdleGate::leave(void) {
+
+   if(!inside)
+      return;
+
+   task = dev->getClockSetting();
+   taskClockSet = true;
+   dev->setClockSetting(client);
+
+   // back to the state and instruction the client left; TEST-LOGIC-RESET loads the
+   // reset instruction again, other instructions are shifted again if the task changed them
+   std::vector<unsigned char> ir;
+   int irBits = dev->getInstruction(ir);
+
+   seq.begin(dev->getTapState());
+   if(clientState == TAP_RESET)
+      seq.reset();
+   else if(clientState == TAP_IDLE) {
+      if(clientIrBits == 0 && irBits != 0)
+         seq.reset();
+      else if(clientIrBits > 0 && (irBits != clientIrBits || ir != clientIr)) {
+         seq.setPadding({0, 0, 0, 0});
+         seq.irScan(clientIrBits, clientIr.data(), nullptr, TAP_IDLE);
+      }
+      seq.gotoState(TAP_IDLE);
+   }
+   dev->runSequence(seq);
+
+   inside = false;
+   dev->getLock().unlock();
+}
+
+bool IdleGate::yield(void) {
+
+   if(!inside || !dev->isClientWaiting())
+      return false;
+
+   leave();
+   yields++;
+   enter();
+
+   return true;
+}
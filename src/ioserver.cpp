@@ -2,6 +2,7 @@
 #include <signal.h>
 #include <arpa/inet.h>
 #include <cstring>
+#include <sys/ioctl.h>
 
 IOServer::IOServer(XVCDriver *driver) {
 
@@ -44,6 +45,16 @@ void IOServer::setVectorLength(int v) {
    xvcInfo.append("\n");
 }
 
+// shift commands run through an AsyncDriver: commands already received are
+// read and queued while the driver runs the previous ones
+void IOServer::setAsync(bool a) {
+
+   if(a)
+      adrv.reset(new AsyncDriver(drv, verbose));
+   else
+      adrv.reset();
+}
+
 int IOServer::sread(int fd, void *target, int len) {
 
    unsigned char *t = (unsigned char *) target;
@@ -130,6 +141,9 @@ void IOServer::start(void) {
                      maxfd = newfd;
 
                   FD_SET(newfd, &conn);
+
+                  if (sessionHook)
+                     sessionHook(true);
                }
             
             } else if (handleData(fd)) {
@@ -140,9 +154,7 @@ void IOServer::start(void) {
                   std::cout << "IOServer: connection closed - fd " << fd << " (" << clntName << ")" << std::endl;
                }
 
-               close(fd);
-
-               FD_CLR(fd, &conn);
+               closeSession(fd);
             }
          
          } else if (FD_ISSET(fd, &except)) {
@@ -150,16 +162,136 @@ void IOServer::start(void) {
             if (verbose)
                std::cout << "IOServer: connection aborted - fd " << fd << std::endl;
 
-            close(fd);
-            FD_CLR(fd, &conn);
-
-            if (fd == sock)
+            if (fd == sock) {
+               close(fd);
+               FD_CLR(fd, &conn);
                break;
+            }
+
+            closeSession(fd);
          }
       } // end for
    } // end while
 }
 
+void IOServer::closeSession(int fd) {
+
+   close(fd);
+   FD_CLR(fd, &conn);
+
+   if (sessionHook)
+      sessionHook(false);
+}
+
+// length of next shift command if it is already completely received, -1 otherwise
+// size is the payload already batched
+int IOServer::queuedShift(int fd, int size) {
+
+   unsigned char hdr[10];
+   int avail, nbits, nbytes;
+
+   if ((ioctl(fd, FIONREAD, &avail) < 0) || (avail < 10))
+      return -1;
+
+   if ((recv(fd, hdr, 10, MSG_PEEK) != 10) || (memcmp(hdr, "shift:", 6) != 0))
+      return -1;
+
+   memcpy(&nbits, hdr + 6, 4);
+   nbytes = (nbits + 7) / 8;
+
+   if ((nbits <= 0) || (nbytes * 2 > vectorLength) || (avail < 10 + nbytes * 2) ||
+      (size + nbytes * 2 > 4 * vectorLength))
+      return -1;
+
+   return nbits;
+}
+
+// append shift commands already received to data, -1 on read error
+int IOServer::readQueued(int fd, std::vector<unsigned char> &data, std::vector<int> &lengths, int max) {
+
+   int count = 0;
+   int next;
+
+   while ((count < max) && ((next = queuedShift(fd, data.size())) > 0)) {
+
+      int size = data.size();
+      int nb = (next + 7) / 8;
+      char hdr[10];
+
+      data.resize(size + nb * 2);
+      if ((sread(fd, hdr, 10) != 1) || (sread(fd, data.data() + size, nb * 2) != 1)) {
+         std::cout << "E: IOServer: reading data failed " << std::endl;
+         return -1;
+      }
+
+      lengths.push_back(next);
+      count++;
+   }
+
+   return count;
+}
+
+void IOServer::submitBatch(shift_batch &b) {
+
+   int rdlen = b.data.size() / 2;
+   b.result.resize(rdlen);
+
+   b.segs.clear();
+   for (unsigned int i = 0, in = 0, out = 0; i < b.lengths.size(); i++) {
+      int nb = (b.lengths[i] + 7) / 8;
+      b.segs.push_back({b.lengths[i], b.data.data() + in, b.data.data() + in + nb, b.result.data() + out});
+      in += nb * 2;
+      out += nb;
+   }
+
+   b.done = adrv->submitv(b.segs);
+}
+
+bool IOServer::replyBatch(int fd, shift_batch &b) {
+
+   try {
+      b.done.get();
+   } catch (const std::exception&) {
+      return false;
+   }
+
+   int rdlen = b.result.size();
+   int nb = write(fd, b.result.data(), rdlen);
+   if (nb != rdlen) 
+      std::cout << "E: IOServer: failed to write data to client - " << nb << " (expected: " << rdlen << ") errno: " << std::strerror(errno) << std::endl;
+
+   return true;
+}
+
+// first batch is in batches[0], next batch is read while the previous one runs
+bool IOServer::pipelineShifts(int fd) {
+
+   int cur = 0;
+   submitBatch(batches[cur]);
+
+   while (true) {
+
+      shift_batch &next = batches[cur ^ 1];
+      next.data.clear();
+      next.lengths.clear();
+
+      int count = readQueued(fd, next.data, next.lengths, MAX_BATCH);
+      if (count > 0) {
+         if (verbose)
+            std::cout << "IOServer: queued " << count << " shift commands" << std::endl;
+         submitBatch(next);
+      }
+
+      if ((!replyBatch(fd, batches[cur])) || (count < 0))
+         return false;
+
+      if (count <= 0)
+         return true;
+
+      cur ^= 1;
+   }
+}
+
 bool IOServer::handleData(int fd) {
 
    char cmd[16];
@@ -259,15 +391,68 @@ bool IOServer::handleData(int fd) {
          std::cout << "IOServer: number of bytes " << nbytes << std::endl;
       }
 
-      drv->shift(nbits, buffer, result);
+      if (adrv) {
+
+         shift_batch &b = batches[0];
+         b.data.assign(buffer, buffer + nbytes * 2);
+         b.lengths.assign(1, nbits);
+
+         if ((readQueued(fd, b.data, b.lengths, MAX_BATCH - 1) < 0) || (!pipelineShifts(fd)))
+            return 1;
+
+         continue;
+      }
+
+      // shift commands already queued by the client run in the same driver transaction
+      std::vector<int> lengths;
+
+      batchBuffer.clear();
+      if (readQueued(fd, batchBuffer, lengths, MAX_BATCH - 1) < 0)
+         return 1;
+
+      if (lengths.empty()) {
+
+         {
+            ClientLock guard(drv);
+            drv->shift(nbits, buffer, result);
+         }
+
+         //sleep(1);
+         //std::cout << "recv/send: " << nbytes << std::endl;
+         
+         int nb;
+         nb = write(fd, result, nbytes);
+         if (nb != nbytes) 
+            std::cout << "E: IOServer: failed to write data to client - " << nb << " (expected: " << nbytes << ") errno: " << std::strerror(errno) << std::endl;
+
+         continue;
+      }
+
+      // replies are sent back in order with a single write
+      int rdlen = nbytes + batchBuffer.size() / 2;
+      batchResult.resize(rdlen);
+
+      segments.clear();
+      segments.push_back({nbits, buffer, buffer + nbytes, batchResult.data()});
+      for (unsigned int i = 0, in = 0, out = nbytes; i < lengths.size(); i++) {
+         int nb = (lengths[i] + 7) / 8;
+         segments.push_back({lengths[i], batchBuffer.data() + in, batchBuffer.data() + in + nb, batchResult.data() + out});
+         in += nb * 2;
+         out += nb;
+      }
+
+      if (verbose)
+         std::cout << "IOServer: batched " << segments.size() << " shift commands" << std::endl;
+
+      {
+         ClientLock guard(drv);
+         drv->shiftv(segments);
+      }
 
-      //sleep(1);
-      //std::cout << "recv/send: " << nbytes << std::endl;
-      
       int nb;
-      nb = write(fd, result, nbytes);
-      if (nb != nbytes) 
-         std::cout << "E: IOServer: failed to write data to client - " << nb << " (expected: " << nbytes << ") errno: " << std::strerror(errno) << std::endl;
+      nb = write(fd, batchResult.data(), rdlen);
+      if (nb != rdlen) 
+         std::cout << "E: IOServer: failed to write data to client - " << nb << " (expected: " << rdlen << ") errno: " << std::strerror(errno) << std::endl;
 
    } // end while
 
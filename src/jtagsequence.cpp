@@ -0,0 +1,212 @@
+#include "jtagsequence.h"
+#include "bitvector.h"
+#include <string.h>
+
+static const int nextState[TAP_STATES][2] = {
+   { TAP_IDLE, TAP_RESET },               // TEST-LOGIC-RESET
+   { TAP_IDLE, TAP_SELECT_DR },           // RUN-TEST/IDLE
+   { TAP_CAPTURE_DR, TAP_SELECT_IR },     // SELECT-DR
+   { TAP_SHIFT_DR, TAP_EXIT1_DR },        // CAPTURE-DR
+   { TAP_SHIFT_DR, TAP_EXIT1_DR },        // SHIFT-DR
+   { TAP_PAUSE_DR, TAP_UPDATE_DR },       // EXIT1-DR
+   { TAP_PAUSE_DR, TAP_EXIT2_DR },        // PAUSE-DR
+   { TAP_SHIFT_DR, TAP_UPDATE_DR },       // EXIT2-DR
+   { TAP_IDLE, TAP_SELECT_DR },           // UPDATE-DR
+   { TAP_CAPTURE_IR, TAP_RESET },         // SELECT-IR
+   { TAP_SHIFT_IR, TAP_EXIT1_IR },        // CAPTURE-IR
+   { TAP_SHIFT_IR, TAP_EXIT1_IR },        // SHIFT-IR
+   { TAP_PAUSE_IR, TAP_UPDATE_IR },       // EXIT1-IR
+   { TAP_PAUSE_IR, TAP_EXIT2_IR },        // PAUSE-IR
+   { TAP_SHIFT_IR, TAP_UPDATE_IR },       // EXIT2-IR
+   { TAP_IDLE, TAP_SELECT_DR },           // UPDATE-IR
+};
+
+static const char *stateNames[TAP_STATES] = {
+   "TEST-LOGIC-RESET", "RUN-TEST/IDLE",
+   "SELECT-DR", "CAPTURE-DR", "SHIFT-DR", "EXIT1-DR", "PAUSE-DR", "EXIT2-DR", "UPDATE-DR",
+   "SELECT-IR", "CAPTURE-IR", "SHIFT-IR", "EXIT1-IR", "PAUSE-IR", "EXIT2-IR", "UPDATE-IR"
+};
+
+typedef struct {
+   int len;
+   uint16_t tms;     // TMS bits, first one in bit 0
+} tap_path;
+
+// shortest TMS path between every couple of states (breadth first search)
+static std::vector<tap_path> buildPaths(void) {
+
+   std::vector<tap_path> paths(TAP_STATES * TAP_STATES, {-1, 0});
+
+   for(int from=0; from<TAP_STATES; from++) {
+
+      std::vector<int> queue = { from };
+      paths[from * TAP_STATES + from] = {0, 0};
+
+      for(unsigned int i=0; i<queue.size(); i++) {
+         tap_path p = paths[from * TAP_STATES + queue[i]];
+         for(int tms=0; tms<=1; tms++) {
+            int s = nextState[queue[i]][tms];
+            if(paths[from * TAP_STATES + s].len < 0) {
+               paths[from * TAP_STATES + s] = { p.len + 1, (uint16_t)(p.tms | (tms << p.len)) };
+               queue.push_back(s);
+            }
+         }
+      }
+   }
+
+   return paths;
+}
+
+int tapNextState(int state, int tms) {
+   if(state < 0 || state >= TAP_STATES)
+      return TAP_UNKNOWN;
+   return nextState[state][tms ? 1 : 0];
+}
+
+const char *tapStateName(int state) {
+   if(state < 0 || state >= TAP_STATES)
+      return "UNKNOWN";
+   return stateNames[state];
+}
+
+JTAGSequence::JTAGSequence(int bits) {
+
+   tms.reserve((bits + 7) / 8);
+   tdi.reserve((bits + 7) / 8);
+   buffer.reserve(2 * ((bits + 7) / 8) + 4);
+   result.reserve((bits + 7) / 8 + 4);
+}
+
+void JTAGSequence::begin(int s) {
+
+   tms.clear();
+   tdi.clear();
+   captures.clear();
+   nbits = 0;
+   state = s;
+}
+
+void JTAGSequence::grow(int n) {
+
+   unsigned int nbytes = (nbits + n + 7) / 8;
+
+   if(tms.size() < nbytes) {
+      tms.resize(nbytes, 0);
+      tdi.resize(nbytes, 0);
+   }
+}
+
+// n TCK cycles with TDI low, TMS bits from tmsBits (n <= 64)
+void JTAGSequence::addBits(int n, uint64_t tmsBits) {
+
+   grow(n);
+
+   for(int i=0; i<n; i++) {
+      int bit = (tmsBits >> i) & 1;
+      if(bit)
+         tms[(nbits + i) / 8] |= 1 << ((nbits + i) & 7);
+      state = tapNextState(state, bit);
+   }
+
+   nbits += n;
+}
+
+// TEST-LOGIC-RESET from any state
+void JTAGSequence::reset(void) {
+
+   addBits(5, 0x1F);
+   state = TAP_RESET;
+}
+
+void JTAGSequence::gotoState(int s) {
+
+   static const std::vector<tap_path> paths = buildPaths();
+
+   if(state == TAP_UNKNOWN)
+      reset();
+
+   if(s == state || s < 0 || s >= TAP_STATES)
+      return;
+
+   const tap_path &p = paths[state * TAP_STATES + s];
+   addBits(p.len, p.tms);
+}
+
+// TCK cycles in current state, TMS keeps TEST-LOGIC-RESET or any other stable state
+void JTAGSequence::clocks(int n) {
+
+   if(state == TAP_UNKNOWN)
+      reset();
+
+   uint64_t bits = (state == TAP_RESET) ? ~0ULL : 0;
+
+   while(n > 0) {
+      addBits(n > 64 ? 64 : n, bits);
+      n -= 64;
+   }
+}
+
+void JTAGSequence::scan(int shiftState, int pre, int n, int post, const unsigned char *data, unsigned char *tdo, int end) {
+
+   gotoState(shiftState);
+
+   int total = pre + n + post;
+
+   if(total > 0) {
+
+      grow(total);
+
+      // other devices are kept in BYPASS
+      if(shiftState == TAP_SHIFT_IR) {
+         bitFill(tdi.data(), nbits, pre, 1);
+         bitFill(tdi.data(), nbits + pre + n, post, 1);
+      }
+
+      if(data && n > 0)
+         bitCopy(tdi.data(), nbits + pre, data, 0, n);
+
+      if(tdo && n > 0)
+         captures.push_back({nbits + pre, n, tdo});
+
+      // last bit moves to EXIT1
+      if(end != shiftState) {
+         int last = nbits + total - 1;
+         tms[last / 8] |= 1 << (last & 7);
+         state = shiftState + 1;
+      }
+
+      nbits += total;
+   }
+
+   gotoState(end);
+}
+
+void JTAGSequence::irScan(int n, const unsigned char *data, unsigned char *tdo, int end) {
+   scan(TAP_SHIFT_IR, padding.irPre, n, padding.irPost, data, tdo, end);
+}
+
+void JTAGSequence::drScan(int n, const unsigned char *data, unsigned char *tdo, int end) {
+   scan(TAP_SHIFT_DR, padding.drPre, n, padding.drPost, data, tdo, end);
+}
+
+unsigned char *JTAGSequence::getBuffer(void) {
+
+   int nbytes = (nbits + 7) / 8;
+
+   // drivers may access whole words at the end of TMS[], TDI[] and TDO[]
+   buffer.assign(2 * nbytes + 4, 0);
+   memcpy(buffer.data(), tms.data(), nbytes);
+   memcpy(buffer.data() + nbytes, tdi.data(), nbytes);
+   result.assign(nbytes + 4, 0);
+
+   return buffer.data();
+}
+
+// copy TDO of each scan to its destination, unused bits of last byte are cleared
+void JTAGSequence::scatter(void) {
+
+   for(unsigned int i=0; i<captures.size(); i++) {
+      captures[i].tdo[(captures[i].nbits - 1) / 8] = 0;
+      bitCopy(captures[i].tdo, 0, result.data(), captures[i].pos, captures[i].nbits);
+   }
+}
@@ -0,0 +1,157 @@
+#include "pointselector.h"
+#include "bertester.h"
+#include <algorithm>
+#include <stdlib.h>
+
+void PointSelector::printDebug(std::string msg, int lvl) {
+   if (debugLevel >= lvl)
+      std::cout << msg << std::endl;
+}
+
+bool PointSelector::setPolicy(std::string p) {
+
+   std::string base = p.substr(0, p.find(':'));
+   int pct = (p.find(':') != std::string::npos) ? atoi(p.substr(p.find(':') + 1).c_str()) : 0;
+
+   if(base == "MAXFREQ" && p == base)
+      policy = POLICY_MAXFREQ;
+   else if(base == "MARGIN" && p != base)
+      policy = POLICY_MARGIN;
+   else if(base == "THROUGHPUT")
+      policy = POLICY_THROUGHPUT;
+   else return false;
+
+   if(pct < 0 || pct > 100)
+      return false;
+
+   minMargin = pct;
+   name = p;
+   return true;
+}
+
+// points are taken from the fastest one; throughput is measured until clock frequency
+// (the upper bound of throughput) drops below the equivalent range of the best one
+int PointSelector::choose(XVCDriver *d, std::vector<point_score> &points, std::function<void(int index)> apply) {
+
+   std::sort(points.begin(), points.end(), [](const point_score &a, const point_score &b) {
+      return (a.frequency != b.frequency) ? a.frequency > b.frequency : a.margin > b.margin;
+   });
+
+   int best = -1;
+   int skipped = 0;
+   double top = 0;
+
+   for(unsigned int i=0; i<points.size(); i++) {
+
+      point_score &p = points[i];
+
+      if(p.margin < minMargin) {
+         printDebug("PointSelector::choose id " + std::to_string(p.id) + " margin " + std::to_string(p.margin) + "% rejected", 2);
+         skipped++;
+         continue;
+      }
+
+      if(policy != POLICY_THROUGHPUT) {
+         best = i;
+         break;
+      }
+
+      if(top > 0 && p.frequency < top * (1 - POLICY_TOLERANCE))
+         break;
+
+      apply(p.index);
+
+      BERTester ber(d, verbose, debugLevel);
+      ber.setPattern(prbsOrder);
+      ber_result r = ber.run(checkBits, 1);
+
+      p.throughput = r.bitRate;
+      p.errors = r.errors;
+
+      printf("I: policy %s: id %d %d Hz margin %d%% - %.2f Mbit/s, %s\n", name.c_str(), p.id, p.frequency, p.margin,
+         p.throughput / 1E6, p.errors ? "bit errors" : "no bit errors");
+
+      if(p.errors == 0 && p.throughput > top)
+         top = p.throughput;
+   }
+
+   // widest margin among the points as fast as the best one
+   if(policy == POLICY_THROUGHPUT) {
+      for(unsigned int i=0; i<points.size(); i++) {
+         point_score &p = points[i];
+         if(p.throughput > 0 && p.errors == 0 && p.throughput >= top * (1 - POLICY_TOLERANCE) &&
+            (best == -1 || p.margin > points[best].margin))
+            best = i;
+      }
+   }
+
+   if(best == -1) {
+      std::cout << "E: policy " << name << ": no calibrated point satisfies the policy" << std::endl;
+      return -1;
+   }
+
+   point_score &p = points[best];
+
+   if(policy == POLICY_MAXFREQ)
+      printf("I: policy %s: id %d chosen - highest frequency %d Hz, margin %d%%\n", name.c_str(), p.id, p.frequency, p.margin);
+   else if(policy == POLICY_MARGIN)
+      printf("I: policy %s: id %d chosen - highest frequency %d Hz with margin %d%% >= %d%%, %d faster points with less margin\n",
+         name.c_str(), p.id, p.frequency, p.margin, minMargin, skipped);
+   else
+      printf("I: policy %s: id %d chosen - %.2f Mbit/s without bit errors over %lu bits (best %.2f Mbit/s), margin %d%% at %d Hz\n",
+         name.c_str(), p.id, p.throughput / 1E6, (unsigned long) checkBits, top / 1E6, p.margin, p.frequency);
+
+   apply(p.index);
+   return p.index;
+}
+
+AXICalibItem *PointSelector::select(AXIDevice *d, AXISetup *setup) {
+
+   std::vector<point_score> points;
+
+   for(int i=0; i<setup->getListSize(); i++) {
+      AXICalibItem *item = setup->getItemByIndex(i);
+      points.push_back({i, item->getId(), item->getClockFrequency(), item->getEyeWidth(), 0, 0});
+   }
+
+   int index = choose(d, points, [d, setup](int i) {
+      AXICalibItem *item = setup->getItemByIndex(i);
+      d->setClockDiv(item->getClockDivisor());
+      d->setClockDelay(item->getClockDelay());
+   });
+
+   return (index >= 0) ? setup->getItemByIndex(index) : nullptr;
+}
+
+FTDICalibItem *PointSelector::select(FTDIDevice *d, FTDISetup *setup) {
+
+   std::vector<point_score> points;
+   FTDICalibItem *top[2] = {nullptr, nullptr};
+
+   for(int i=0; i<setup->getListSize(); i++) {
+      FTDICalibItem *item = setup->getItemByIndex(i);
+      if(!top[item->getTDOSampling()] || item->getClockFrequency() > top[item->getTDOSampling()]->getClockFrequency())
+         top[item->getTDOSampling()] = item;
+   }
+
+   for(int i=0; i<setup->getListSize(); i++) {
+      FTDICalibItem *item = setup->getItemByIndex(i);
+      int margin = item->getMargin();
+      // files without margin column: the clock next to the fastest point of the edge counts as failing
+      if(margin < 0) {
+         FTDICalibItem *t = top[item->getTDOSampling()];
+         int fail = t->getClockDiv5() ? d->getFrequencyByDivisor(DIV5_OFF, 0xFFFF) :
+            (t->getClockDivisor() > 0) ? d->getFrequencyByDivisor(DIV5_OFF, t->getClockDivisor() - 1) : 0;
+         margin = fail ? (int)((fail - item->getClockFrequency()) * 100LL / fail) : 100;
+      }
+      points.push_back({i, item->getId(), item->getClockFrequency(), margin, 0, 0});
+   }
+
+   int index = choose(d, points, [d, setup](int i) {
+      FTDICalibItem *item = setup->getItemByIndex(i);
+      d->setClockDiv(item->getClockDiv5(), item->getClockDivisor());
+      d->setTDOPosSampling((bool)item->getTDOSampling());
+   });
+
+   return (index >= 0) ? setup->getItemByIndex(index) : nullptr;
+}
@@ -0,0 +1,108 @@
+#include "probeengine.h"
+#include "bitvector.h"
+#include <string.h>
+
+ProbeEngine::ProbeEngine(XVCDriver *d) : seq(4096) {
+   dev = d;
+}
+
+// BYPASS instruction on every device, TAP is left in SHIFT-DR; after a failed probe the
+// TAP state is not trusted and navigation starts from TEST-LOGIC-RESET
+void ProbeEngine::enterBypass(void) {
+
+   int irlen = dev->getIrLen();
+   std::vector<unsigned char> ir((irlen + 7) / 8 + 1, 0xFF);
+
+   seq.begin(failed ? TAP_UNKNOWN : dev->getTapState());
+   seq.setPadding(dev->getPadding());
+   seq.irScan(irlen, ir.data(), nullptr, TAP_SHIFT_DR);
+   seq.setPadding({0, 0, 0, 0});
+
+   navigations++;
+   ready = true;
+   failed = false;
+}
+
+uint64_t ProbeEngine::probeBits(const unsigned char *tdi, int nbits, unsigned char *tdo) {
+
+   // bits of the bypass registers come out first
+   int delay = dev->getChain().empty() ? 1 : dev->getChain().size();
+   int total = nbits + delay;
+
+   // clients may move the TAP meanwhile, the state check below navigates back;
+   // after a failed probe BYPASS is loaded again from TEST-LOGIC-RESET
+   if(gate)
+      gate->yield();
+
+   if(!ready || failed || dev->getTapState() != TAP_SHIFT_DR)
+      enterBypass();
+   else
+      seq.begin(TAP_SHIFT_DR);
+
+   data.assign((total + 7) / 8, 0);
+   result.assign((total + 7) / 8, 0);
+   bitCopy(data.data(), 0, tdi, 0, nbits);
+
+   seq.drScan(total, data.data(), result.data(), TAP_SHIFT_DR);
+   dev->runSequence(seq);
+   shifts++;
+
+   bitShiftRight(result.data(), result.data(), total, delay);
+
+   if(tdo && nbits > 0) {
+      tdo[(nbits - 1) / 8] = 0;
+      bitCopy(tdo, 0, result.data(), 0, nbits);
+   }
+
+   uint64_t errors = bitMismatches(tdi, result.data(), nbits);
+
+   if(errors)
+      failed = true;
+
+   return errors;
+}
+
+bool ProbeEngine::probeWords(const std::vector<uint32_t> &words) {
+
+   std::vector<unsigned char> tdi(4 * words.size());
+
+   for(unsigned int i=0; i<words.size(); i++)
+      bitPut(tdi.data(), 32*i, words[i], 32);
+
+   return probeBits(tdi.data(), 32 * words.size()) == 0;
+}
+
+int ProbeEngine::probeIdCodes(int n) {
+
+   int irlen = dev->getIrLen();
+   int idcmd = dev->getIdCmd();
+   std::vector<unsigned char> ir((irlen + 7) / 8 + 4, 0);
+   int valid = 0;
+
+   if(gate)
+      gate->yield();
+
+   for(int i=0; i<4; i++)
+      ir[i] = (idcmd >> 8*i) & 0x000000FF;
+
+   result.assign(4 * n, 0);
+
+   // every Capture-DR loads IDCODE again
+   seq.begin(TAP_UNKNOWN);
+   seq.setPadding(dev->getPadding());
+   seq.irScan(irlen, ir.data());
+   for(int i=0; i<n; i++)
+      seq.drScan(32, nullptr, result.data() + 4*i);
+   dev->runSequence(seq);
+   shifts++;
+
+   for(int i=0; i<n; i++)
+      if(bitGet(result.data(), 32*i, 32) == dev->getIdCode())
+         valid++;
+
+   // instruction register does not hold BYPASS anymore
+   ready = false;
+   failed = (valid != n);
+
+   return valid;
+}
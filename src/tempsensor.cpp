@@ -0,0 +1,85 @@
+#include "tempsensor.h"
+#include "bitvector.h"
+
+TempSensor::TempSensor(XVCDriver *d, bool v, int dl) : seq(256) {
+
+   dev = d;
+   verbose = v;
+   debugLevel = dl;
+
+   // DRP instruction is private to Xilinx devices
+   xilinx = ((dev->getIdCode() >> 1) & 0x7FF) == XILINX_MANUFACTURER;
+
+   // transfer function of the sensor follows the family of the target device
+   std::string desc = dev->getDescription();
+   if(desc.compare(0, 4, "XCZU") == 0 || ((desc.compare(0, 4, "XCKU") == 0 || desc.compare(0, 4, "XCVU") == 0) &&
+      desc.find('P') != std::string::npos))
+      type = SENSOR_SYSMON4;
+   else if(desc.compare(0, 4, "XCKU") == 0 || desc.compare(0, 4, "XCVU") == 0)
+      type = SENSOR_SYSMON;
+   else
+      type = SENSOR_XADC;
+
+   // Zynq UltraScale+ chains PS and PL TAPs in a 12 bit IR
+   bool zynqmp = (desc.compare(0, 4, "XCZU") == 0);
+   drpIrLen = zynqmp ? 12 : 6;
+   drpCmd = zynqmp ? ZYNQMP_DRP_CMD : XADC_DRP_CMD;
+}
+
+void TempSensor::printDebug(std::string msg, int lvl) {
+   if (debugLevel >= lvl)
+      std::cout << msg << std::endl;
+}
+
+bool TempSensor::read(double &celsius) {
+
+   int irlen = dev->getIrLen();
+   unsigned char ir[4], cmd[4], nop[4] = {0, 0, 0, 0};
+
+   // multi-die devices use longer instructions
+   if(!xilinx || irlen != drpIrLen)
+      return false;
+
+   bitPut(ir, 0, drpCmd, 32);
+   bitPut(cmd, 0, (XADC_DRP_READ << 26) | (XADC_TEMP_ADDR << 16), 32);
+   result.assign(4, 0);
+
+   seq.begin(TAP_UNKNOWN);
+   seq.setPadding(dev->getPadding());
+   seq.irScan(irlen, ir);
+   seq.drScan(32, cmd);
+   seq.drScan(32, nop, result.data());
+   dev->runSequence(seq);
+
+   uint32_t word = bitGet(result.data(), 0, 32);
+   uint32_t code = word & 0xFFFF;
+
+   if(debugLevel) {
+      char msg[64];
+      sprintf(msg, "TempSensor::read DRP word 0x%08X", word);
+      printDebug(msg, 2);
+   }
+
+   // bypass registers or a missing sensor read back as all zeros or ones
+   if(code == 0 || code == 0xFFFF)
+      return false;
+
+   switch(type) {
+      case SENSOR_SYSMON4:
+         celsius = code * 509.3140064 / 65536 - 280.23087870;
+         break;
+      case SENSOR_SYSMON:
+         celsius = (code >> 6) * 502.9098 / 1024 - 273.8195;
+         break;
+      default:
+         celsius = (code >> 4) * 503.975 / 4096 - 273.15;
+   }
+
+   if(celsius < -60 || celsius > 150)
+      return false;
+
+   if(verbose)
+      printf("TempSensor: die temperature %.1f C\n", celsius);
+
+   return true;
+}
@@ -0,0 +1,212 @@
+#include "thermalmonitor.h"
+#include "bertester.h"
+#include <chrono>
+
+ThermalMonitor::ThermalMonitor(AXIDevice *d, AXICalibrator *c, TempSensor *s, ThermalTables *t, bool v, int dl) : gate(d), seq(64) {
+
+   dev = d;
+   calib = c;
+   sensor = s;
+   tables = t;
+   table = new AXISetup();
+   verbose = v;
+   debugLevel = dl;
+}
+
+ThermalMonitor::~ThermalMonitor() {
+   stop();
+}
+
+void ThermalMonitor::printDebug(std::string msg, int lvl) {
+   if (debugLevel >= lvl)
+      std::cout << msg << std::endl;
+}
+
+void ThermalMonitor::start(int b) {
+
+   band = b;
+   worker = std::thread(&ThermalMonitor::run, this);
+}
+
+void ThermalMonitor::stop(void) {
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      stopped = true;
+   }
+   wakeCond.notify_all();
+
+   if(worker.joinable())
+      worker.join();
+}
+
+void ThermalMonitor::session(bool open) {
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      sessions += open ? 1 : -1;
+   }
+   wakeCond.notify_all();
+}
+
+// sec seconds and then the end of open sessions, false when the monitor is stopped meanwhile
+bool ThermalMonitor::wait(int sec) {
+
+   std::unique_lock<std::mutex> guard(lock);
+   if(wakeCond.wait_for(guard, std::chrono::seconds(sec), [this]{ return stopped; }))
+      return false;
+
+   wakeCond.wait(guard, [this]{ return stopped || sessions == 0; });
+   return !stopped;
+}
+
+thermal_metrics ThermalMonitor::getMetrics(void) {
+
+   std::lock_guard<std::mutex> guard(lock);
+   return metrics;
+}
+
+void ThermalMonitor::printMetrics(void) {
+
+   std::lock_guard<std::mutex> guard(lock);
+   std::cout << "I: thermal monitor: " << metrics.samples << " samples, " << metrics.readErrors << " read errors, " <<
+      metrics.switches << " table switches, " << metrics.calibrations << " calibrations" << std::endl;
+}
+
+void ThermalMonitor::run(void) {
+
+   // clients run at the point of the start band until the first switch
+   client = dev->getClockSetting();
+
+   std::cout << "I: thermal monitor: sampling die temperature every " << period << " s between client sessions, band " <<
+      tables->getBandFloor(band) << " C" << std::endl;
+
+   while(wait(period)) {
+      // a session opened before the driver was locked gets the sample at its end
+      while(!check()) {
+         if(!wait(0))
+            return;
+      }
+   }
+}
+
+// temperature read at the clock setup of clients, at the slowest clock when the table
+// of the band doesn't hold anymore
+bool ThermalMonitor::sample(double &celsius, bool &failed) {
+
+   dev->setClockSetting(client);
+   failed = false;
+
+   if(sensor->read(celsius))
+      return true;
+
+   failed = true;
+   return calib->setSafeClock() && sensor->read(celsius);
+}
+
+// runs between client sessions holding the driver: a client connecting meanwhile waits
+// for the sample; the table of a new band is loaded and checked, the TAP is left in
+// TEST-LOGIC-RESET at the client clock setup; false if a session opened before the lock
+bool ThermalMonitor::check(void) {
+
+   double celsius;
+   bool failed;
+   bool switched = false;
+   int next = band;
+
+   {
+      std::lock_guard<std::mutex> driver(dev->getLock());
+
+      {
+         std::lock_guard<std::mutex> guard(lock);
+         if(sessions > 0)
+            return false;
+      }
+
+      bool valid = sample(celsius, failed);
+
+      if(valid) {
+         next = tables->nextBand(band, celsius);
+         printDebug("ThermalMonitor::check " + std::to_string(celsius) + " C - band: " + std::to_string(tables->getBandFloor(next)), 2);
+      }
+
+      switched = valid && (next != band || failed) && tables->restore(dev, table, next, freq);
+      if(switched)
+         client = dev->getClockSetting();
+
+      // reset instruction replaces XADC_DRP
+      dev->setClockSetting(client);
+      seq.begin(dev->getTapState());
+      seq.reset();
+      dev->runSequence(seq);
+
+      std::lock_guard<std::mutex> guard(lock);
+      if(valid)
+         metrics.samples++;
+      else
+         metrics.readErrors++;
+
+      if(!valid || (next == band && !failed))
+         return true;
+
+      if(switched)
+         metrics.switches++;
+   }
+
+   // band without valid table is calibrated in idle gaps between client shifts
+   if(!switched && !calibrate(table, next)) {
+      // band is tried again on next sample, clients keep their clock setup
+      std::cout << "E: thermal monitor: no valid point for band " << tables->getBandFloor(next) << " C" << std::endl;
+      return true;
+   }
+
+   printf("I: thermal monitor: %.1f C - band %d C -> %d C - clkdiv: %d - clkdelay: %d\n",
+      celsius, tables->getBandFloor(band), tables->getBandFloor(next), client.divisor, client.delay);
+   band = next;
+
+   printMetrics();
+   return true;
+}
+
+// calibration of a band without valid table, probes yield to waiting clients
+bool ThermalMonitor::calibrate(AXISetup *setup, int next) {
+
+   gate.setClientClock(client);
+   gate.enter();
+
+   calib->setGate(&gate);
+   calib->start(setup, calibSize);
+   calib->setGate(nullptr);
+
+   {
+      std::lock_guard<std::mutex> guard(lock);
+      metrics.calibrations++;
+   }
+
+   bool valid = (setup->getListSize() > 0);
+
+   if(valid) {
+
+      if(tables->save(setup, next))
+         std::cout << "I: thermal tables: calibration data saved in " << tables->getFilename(next) << std::endl;
+
+      AXICalibItem *item = (freq != -1) ? setup->getItemByFrequency(freq) : setup->getItemByMaxFrequency();
+      dev->setClockDiv(item->getClockDivisor());
+      dev->setClockDelay(item->getClockDelay());
+
+      BERTester ber(dev, verbose, debugLevel);
+      ber.setGate(&gate);
+      valid = (ber.run(THERMAL_CHECK_BITS, 1).errors == 0);
+   }
+
+   // clients run at the new point once the gate is left
+   if(valid) {
+      client = dev->getClockSetting();
+      gate.setClientClock(client);
+      std::lock_guard<std::mutex> guard(lock);
+      metrics.switches++;
+   }
+   gate.leave();
+
+   return valid;
+}
@@ -0,0 +1,73 @@
+#include "thermaltables.h"
+#include "bertester.h"
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <stdlib.h>
+
+ThermalTables::ThermalTables(std::string d, int w, bool v) {
+
+   dir = d;
+   width = (w > 0) ? w : THERMAL_BAND;
+   verbose = v;
+}
+
+void ThermalTables::setKey(XVCDriver *d) {
+   idcode = d->getIdCode();
+}
+
+int ThermalTables::getBand(double celsius) {
+   return (int) floor(celsius / width);
+}
+
+int ThermalTables::nextBand(int band, double celsius) {
+
+   if(celsius >= getBandFloor(band) - THERMAL_HYST && celsius < getBandFloor(band + 1) + THERMAL_HYST)
+      return band;
+
+   return getBand(celsius);
+}
+
+std::string ThermalTables::getFilename(int band) {
+
+   std::stringstream ss;
+
+   ss << dir << "/axi-" << std::hex << std::setw(8) << std::setfill('0') << idcode << std::dec << "-" << getBandFloor(band) << "C.txt";
+   return ss.str();
+}
+
+bool ThermalTables::restore(AXIDevice *d, AXISetup *setup, int band, int freq) {
+
+   std::string filename = getFilename(band);
+
+   if(!setup->loadFile(filename)) {
+      std::cout << "I: thermal tables: no table " << filename << std::endl;
+      return false;
+   }
+
+   // tables of another band width don't cover this band
+   if(setup->getMeta("bandwidth") != std::to_string(width) || setup->getListSize() == 0) {
+      std::cout << "I: thermal tables: table " << filename << " belongs to another band width" << std::endl;
+      return false;
+   }
+
+   AXICalibItem *item = (freq != -1) ? setup->getItemByFrequency(freq) : setup->getItemByMaxFrequency();
+   d->setClockDiv(item->getClockDivisor());
+   d->setClockDelay(item->getClockDelay());
+
+   BERTester ber(d, verbose);
+   if(ber.run(THERMAL_CHECK_BITS, 1).errors) {
+      std::cout << "I: thermal tables: spot check of " << filename << " failed" << std::endl;
+      return false;
+   }
+
+   std::cout << "I: thermal tables: " << filename << " validated" << std::endl;
+   return true;
+}
+
+bool ThermalTables::save(AXISetup *setup, int band) {
+
+   setup->setMeta("band", std::to_string(getBandFloor(band)));
+   setup->setMeta("bandwidth", std::to_string(width));
+   return setup->saveFile(getFilename(band));
+}
@@ -1,4 +1,10 @@
 #include "xvcdriver.h"
+#include "devicedb.h"
+#include "bitvector.h"
+#include <string.h>
+
+static const unsigned char ones[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const scan_padding noPadding = {0, 0, 0, 0};
 
 XVCDriver::XVCDriver(void) {
 }
@@ -8,205 +14,432 @@ void XVCDriver::printDebug(std::string msg, int lvl) {
       std::cout << msg << std::endl;
 }
 
+void XVCDriver::clientLock(void) {
+
+   clientWaiting++;
+   shareLock.lock();
+   clientWaiting--;
+}
+
+void XVCDriver::clientUnlock(void) {
+
+   lastClientShift = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+   shareLock.unlock();
+}
+
+double XVCDriver::getIdleTime(void) {
+
+   int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+   return (now - lastClientShift) / 1E9;
+}
+
+// TAP state from TMS bits, TEST-LOGIC-RESET is known after five TMS high bits from any state;
+// TDI bits of SHIFT-IR are kept as the instruction of the chain loaded by Update-IR
+void XVCDriver::trackTMS(int nbits, const unsigned char *tms, const unsigned char *tdi) {
+
+   int i = 0;
+
+   while (i < nbits) {
+
+      // whole bytes keeping the current state
+      if (((i & 7) == 0) && (i + 8 <= nbits) && (tapState != TAP_SHIFT_IR)) {
+
+         unsigned char b = tms[i / 8];
+
+         if ((b == 0x00) && (tapState == TAP_UNKNOWN)) {
+            tmsHighCount = 0;
+            i += 8;
+            continue;
+         }
+
+         if (((b == 0x00) && (tapNextState(tapState, 0) == tapState)) ||
+            ((b == 0xFF) && (tapState == TAP_RESET))) {
+            i += 8;
+            continue;
+         }
+      }
+
+      int bit = (tms[i / 8] >> (i & 7)) & 1;
+
+      if (tapState == TAP_UNKNOWN) {
+         tmsHighCount = bit ? tmsHighCount + 1 : 0;
+         if (tmsHighCount >= 5) {
+            tapState = TAP_RESET;
+            irBits = 0;
+         }
+      } else {
+         if (tapState == TAP_SHIFT_IR) {
+            // instructions longer than the chain limit are not tracked
+            if (irShiftBits < MAX_CHAIN_IRLEN)
+               bitPut(irShift, irShiftBits, tdi ? (tdi[i / 8] >> (i & 7)) & 1 : 0, 1);
+            irShiftBits++;
+         }
+
+         tapState = tapNextState(tapState, bit);
+
+         if (tapState == TAP_CAPTURE_IR)
+            irShiftBits = 0;
+         else if (tapState == TAP_UPDATE_IR) {
+            irBits = (irShiftBits <= MAX_CHAIN_IRLEN) ? irShiftBits : -1;
+            memcpy(irValue, irShift, sizeof(irValue));
+         } else if (tapState == TAP_RESET)
+            irBits = 0;
+      }
+
+      i++;
+   }
+}
+
+int XVCDriver::getInstruction(std::vector<unsigned char> &ir) {
+
+   if (irBits > 0)
+      ir.assign(irValue, irValue + (irBits + 7) / 8);
+   else ir.clear();
+
+   return irBits;
+}
+
+// whole sequence in a single shift
+void XVCDriver::runSequence(JTAGSequence &s) {
+
+   if (s.getBits() == 0)
+      return;
+
+   // result is allocated with the buffer
+   unsigned char *buffer = s.getBuffer();
+   shift(s.getBits(), buffer, s.getResult());
+   s.scatter();
+}
+
 uint32_t XVCDriver::probeIdCode(void) {
 
    printDebug("XVCDriver::probeIdCode start", 1);
 
-   std::vector<unsigned char> buffer;
+   unsigned char ir[4];
    unsigned char result[4];
-   uint32_t *idcode;
-   int nbits;
-
-   // TEST-LOGIC-RESET
-   buffer = {0xFF, 0x00};
-   nbits = 5;
-   shift(nbits, buffer.data(), result);
-
-   // RUN-TEST/IDLE
-   buffer = {0x00, 0x00};
-   nbits = 1;
-   shift(nbits, buffer.data(), result);
-
-   // SHIFT-IR
-   buffer = {0x03, 0x00};
-   nbits = 4;
-   shift(nbits, buffer.data(), result);
-
-   // set IDcode instruction and navigate to EXIT-IR on last bit
-   uint32_t tms = 1 << (irlen-1);
-   uint32_t tdi = idcmd;
-   int nbytes = (irlen + 7) / 8;
-   for(int i=0; i<nbytes; i++) {
-      buffer[i] = (tms >> 8*i) & 0x000000FF;
-      buffer[i+nbytes] = (tdi >> 8*i) & 0x000000FF;
-   }
-   nbits = irlen;
-   shift(nbits, buffer.data(), result);
+   uint32_t idcode;
 
-   // UPDATE-IR
-   buffer = {0x01, 0x00};
-   nbits = 2;
-   shift(nbits, buffer.data(), result);
+   for(int i=0; i<4; i++)
+      ir[i] = (idcmd >> 8*i) & 0x000000FF;
 
-   // SHIFT-DR
-   buffer = {0x01, 0x00};
-   nbits = 3;
-   shift(nbits, buffer.data(), result);
+   // detection starts from TEST-LOGIC-RESET whatever the tracked state
+   seq.begin(TAP_UNKNOWN);
+   seq.setPadding(padding);
+   seq.irScan(irlen, ir);
+   seq.drScan(32, nullptr, result);
+   runSequence(seq);
 
-   buffer = {0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00};
-   nbits = 32;
-   shift(nbits, buffer.data(), result);
+   memcpy(&idcode, result, 4);
 
-   idcode = reinterpret_cast<uint32_t *>(result);
-   
    printDebug("XVCDriver::probeIdCode end", 1);
 
-   return *idcode;
+   return idcode;
 }
 
+uint32_t XVCDriver::probeResetCode(void) {
+
+   unsigned char result[4];
+   uint32_t code;
+
+   // TEST-LOGIC-RESET selects IDCODE (or BYPASS) on every device
+   seq.begin(TAP_UNKNOWN);
+   seq.setPadding({0, 0, 0, 0});
+   seq.drScan(32, nullptr, result);
+   runSequence(seq);
+
+   memcpy(&code, result, 4);
+   return code;
+}
+
+static int getBit(const unsigned char *data, int pos) {
+   return (data[pos / 8] >> (pos & 7)) & 1;
+}
+
+// enumerate devices of the chain and select the target device, IDCODE of the target is returned
 uint32_t XVCDriver::scanChain(void) {
 
    printDebug("XVCDriver::scanChain start", 3);
 
-   std::vector<unsigned char> buffer;
-   unsigned char result[6];
-   uint32_t idcode32;
-   uint64_t *idcode64;
-   int nbits;
+   DeviceDB devDB(0);
+   std::vector<chain_device> devs;
+   int drbits = 32 * (MAX_CHAIN_DEVICES + 1);
+   std::vector<unsigned char> drIn(drbits / 8, 0xFF), drOut(drbits / 8);
+   std::vector<unsigned char> irIn(MAX_CHAIN_IRLEN / 4, 0), irOut(MAX_CHAIN_IRLEN / 4);
+   bool end = false;
+   int pos = 0;
+
+   // zeros then ones: ones appear on TDO after the whole IR length
+   memset(irIn.data() + MAX_CHAIN_IRLEN / 8, 0xFF, MAX_CHAIN_IRLEN / 8);
+
+   // IDCODE registers (BYPASS for devices without IDCODE) are selected by TEST-LOGIC-RESET,
+   // ones shifted in mark the end of the chain; IR scan reads Capture-IR patterns and leaves BYPASS
+   seq.begin(TAP_UNKNOWN);
+   seq.setPadding(noPadding);
+   seq.drScan(drbits, drIn.data(), drOut.data());
+   seq.irScan(2 * MAX_CHAIN_IRLEN, irIn.data(), irOut.data());
+   runSequence(seq);
+
+   while((pos + 32 <= drbits) && (devs.size() < MAX_CHAIN_DEVICES)) {
+
+      // BYPASS register captures 0, IDCODE starts with 1
+      if(getBit(drOut.data(), pos) == 0) {
+         devs.push_back({0, 0, 0, "unknown (no IDCODE)"});
+         pos++;
+         continue;
+      }
+
+      uint32_t id = 0;
+      for(int i=0; i<32; i++)
+         id |= (uint32_t) getBit(drOut.data(), pos + i) << i;
+
+      if(id == 0xFFFFFFFF) {
+         end = true;
+         break;
+      }
+
+      const char *d = devDB.idToDescription(id);
+      devs.push_back({id, devDB.idToIRLength(id), (int) devDB.idToIDCmd(id), d ? d : "unknown"});
+      pos += 32;
+   }
 
-   // TMS
-   // 0000.0000.0000.0000.0000.0000.0000.0000.0000.0000.0101.1111
-   // TDI
-   // 0000.0001.1111.1111.1111.1111.1111.1111.1111.1110.0000.0000
+   // whole IR length of the chain
+   int irtotal = -1;
+   for(int i=MAX_CHAIN_IRLEN; i<2*MAX_CHAIN_IRLEN; i++) {
+      if(getBit(irOut.data(), i)) {
+         irtotal = i - MAX_CHAIN_IRLEN;
+         break;
+      }
+   }
 
-   buffer = {0x5F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFF, 0xFF, 0xFF, 0x01};
-   nbits = 41;
-   shift(nbits, buffer.data(), result);
+   if(!end || devs.empty() || irtotal <= 0) {
+      printDebug("XVCDriver::scanChain no valid chain found", 2);
+      printDebug("XVCDriver::scanChain end", 3);
+      return 0;
+   }
 
-   idcode64 = reinterpret_cast<uint64_t *>(result);
-   idcode32 = (uint32_t) ( (*idcode64 >> 9) & (0xFFFFFFFF) );
+   if(!assignIrLengths(devs, irOut.data(), irtotal)) {
+      printDebug("XVCDriver::scanChain IR lengths not consistent with chain", 2);
+      printDebug("XVCDriver::scanChain end", 3);
+      return 0;
+   }
+
+   chain = devs;
+
+   // keep the selected device, otherwise first device of the database
+   int index = target;
+   if(index < 0 || index >= (int) chain.size()) {
+      index = 0;
+      for(unsigned int i=0; i<chain.size(); i++) {
+         if(devDB.idToDescription(chain[i].idcode)) {
+            index = i;
+            break;
+         }
+      }
+   }
+   selectDevice(index);
 
    char msg[128];
-   sprintf(msg, "XVCDriver::scanChain result = 0x%X", idcode32);
-   printDebug(msg, 2);
+   for(unsigned int i=0; i<chain.size(); i++) {
+      sprintf(msg, "XVCDriver::scanChain device %d idcode = 0x%X irlen = %d", i, chain[i].idcode, chain[i].irlen);
+      printDebug(msg, 2);
+   }
 
    printDebug("XVCDriver::scanChain end", 3);
-   return idcode32; 
+   return chain[target].idcode;
 }
 
-void XVCDriver::startBypass(void) {
+// IR lengths from the device database, unknown ones from Capture-IR patterns (01 on TDO side)
+bool XVCDriver::assignIrLengths(std::vector<chain_device> &devs, const unsigned char *capture, int irtotal) {
 
-   std::vector<unsigned char> buffer;
-   unsigned char result[16];
-   int nbits;
-
-   // TEST-LOGIC-RESET
-   buffer = {0xFF, 0x00};
-   nbits = 5;
-   shift(nbits, buffer.data(), result);
-
-   // RUN-TEST/IDLE
-   buffer = {0x00, 0x00};
-   nbits = 1;
-   shift(nbits, buffer.data(), result);
-
-   // SHIFT-IR
-   buffer = {0x03, 0x00};
-   nbits = 4;
-   shift(nbits, buffer.data(), result);
-
-   // set BYPASS instruction and navigate to EXIT-IR on last bit
-   uint32_t tms = 1 << (irlen-1);
-   uint32_t tdi = 0x3F; // (1<<irlen) - 1;   // irlen bits set to 1 
-   int nbytes = (irlen + 7) / 8;
-   for(int i=0; i<nbytes; i++) {
-      buffer[i] = (tms >> 8*i) & 0x000000FF;
-      buffer[i+nbytes] = (tdi >> 8*i) & 0x000000FF;
+   int known = 0, unknown = 0, last = -1;
+
+   for(unsigned int i=0; i<devs.size(); i++) {
+      if(devs[i].irlen > 0)
+         known += devs[i].irlen;
+      else {
+         unknown++;
+         last = i;
+      }
    }
-   nbits = irlen;
-   shift(nbits, buffer.data(), result);
 
-   // UPDATE-IR
-   buffer = {0x01, 0x00};
-   nbits = 2;
-   shift(nbits, buffer.data(), result);
+   if(unknown == 0)
+      return (known == irtotal);
+
+   // every unknown device but the last one ends before the next 01 pattern
+   int pos = 0, sum = 0;
+   for(unsigned int i=0; i<devs.size(); i++) {
+
+      if(devs[i].irlen <= 0 && (int) i != last) {
+         int len = 2;
+         while((pos + len + 1 < irtotal) &&
+            !(getBit(capture, pos + len) == 1 && getBit(capture, pos + len + 1) == 0))
+            len++;
+         devs[i].irlen = len;
+         printf("WARNING: XVCDriver: IR length of device %d guessed from Capture-IR pattern: %d\n", i, len);
+      }
+
+      if((int) i != last) {
+         pos += devs[i].irlen;
+         sum += devs[i].irlen;
+      }
+   }
 
-   // SHIFT-DR
-   buffer = {0x01, 0x00};
-   nbits = 3;
-   shift(nbits, buffer.data(), result);
+   devs[last].irlen = irtotal - sum;
 
+   return (devs[last].irlen >= 2);
+}
+
+// target device of probes and scans, other devices are kept in BYPASS
+bool XVCDriver::selectDevice(int index) {
+
+   if(index < 0 || index >= (int) chain.size())
+      return false;
+
+   DeviceDB devDB(0);
+
+   target = index;
+   idcode = chain[index].idcode;
+   irlen = chain[index].irlen;
+   idcmd = chain[index].idcmd;
+   desc = chain[index].desc;
+   detected = (devDB.idToDescription(idcode) != nullptr);
+
+   padding = {0, 0, index, (int) chain.size() - index - 1};
+   for(int i=0; i<(int) chain.size(); i++) {
+      if(i < index)
+         padding.irPre += chain[i].irlen;
+      else if(i > index)
+         padding.irPost += chain[i].irlen;
+   }
+
+   return true;
+}
+
+// BYPASS instruction on every device from the tracked TAP state, TAP is left in SHIFT-DR
+// and following scans go through all the bypass registers of the chain
+void XVCDriver::addBypassScan(void) {
+
+   seq.begin(tapState);
+   seq.setPadding(padding);
+   seq.irScan(irlen, ones, nullptr, TAP_SHIFT_DR);
+   seq.setPadding(noPadding);
+}
+
+void XVCDriver::startBypass(void) {
+
+   addBypassScan();
+   runSequence(seq);
 }
 
 uint32_t XVCDriver::probeBypass(const uint32_t value) {
 
+   return probeBypass(std::vector<uint32_t>(1, value))[0];
+}
+
+// probe words pass through the bypass register of each device of the chain
+std::vector<uint32_t> XVCDriver::probeBypass(const std::vector<uint32_t> data) {
+
    printDebug("XVCDriver::probeBypass start", 1);
 
-   std::vector<unsigned char> buffer;
-   unsigned char result[16];
-   uint64_t *tmpvalue;
-   uint32_t rdvalue;
-   int nbits;
-
-   startBypass();
-
-   buffer = {0x00, 0x00, 0x00, 0x00, 0x80,
-      (unsigned char)((value & 0x000000FF)), 
-      (unsigned char)((value & 0x0000FF00) >> 8), 
-      (unsigned char)((value & 0x00FF0000) >> 16), 
-      (unsigned char)((value & 0xFF000000) >> 24), 
-      0x00};
-   nbits = 33;
-   shift(nbits, buffer.data(), result);
-
-   tmpvalue = reinterpret_cast<uint64_t *>(result);
-   rdvalue = (*tmpvalue & 0x00000001FFFFFFFF) >> 1;
-   
+   std::vector<uint32_t> retbuf(data.size());
+   int delay = chain.empty() ? 1 : chain.size();
+   int nbits = (32 * data.size()) + delay;
+
+   probeData.assign((nbits + 7) / 8, 0);
+   probeResult.assign((nbits + 7) / 8, 0);
+
+   for(unsigned int i=0; i<data.size(); i++)
+      bitPut(probeData.data(), 32*i, data[i], 32);
+
+   // bypass setup and probe in a single shift
+   addBypassScan();
+   seq.drScan(nbits, probeData.data(), probeResult.data(), TAP_SHIFT_DR);
+   runSequence(seq);
+
+   for(unsigned int i=0; i<data.size(); i++)
+      retbuf[i] = bitGet(probeResult.data(), delay + 32*i, 32);
+
    printDebug("XVCDriver::probeBypass end", 1);
 
-   return rdvalue;
+   return retbuf;
 }
 
-std::vector<uint32_t> XVCDriver::probeBypass(const std::vector<uint32_t> data) {
+// nbits of tdi pass through the bypass registers of the chain, returns the number of
+// bits read back different from tdi; tdo receives them if not null
+uint64_t XVCDriver::probeBypassBits(const unsigned char *tdi, int nbits, unsigned char *tdo) {
 
-   printDebug("XVCDriver::probeBypass start", 1);
+   printDebug("XVCDriver::probeBypassBits start", 1);
 
-   std::vector<unsigned char> buffer;
-   std::vector<uint32_t> retbuf;
-   unsigned char result[4 * data.size() + 1];
-   uint64_t *tmpvalue;
-   uint32_t rdvalue;
-   int nbits;
+   int delay = chain.empty() ? 1 : chain.size();
+   int total = nbits + delay;
 
-   startBypass();
+   probeData.assign((total + 7) / 8, 0);
+   probeResult.assign((total + 7) / 8, 0);
+   bitCopy(probeData.data(), 0, tdi, 0, nbits);
 
-   // build buffer
-   buffer.clear();
-   for(uint16_t i=0; i<data.size(); i++)
-      buffer.insert(buffer.end(), {0x00, 0x00, 0x00, 0x00});
+   addBypassScan();
+   seq.drScan(total, probeData.data(), probeResult.data(), TAP_SHIFT_DR);
+   runSequence(seq);
 
-   buffer.insert(buffer.end(), 0x80);
+   // drop bits of bypass registers shifted out before the probe
+   bitShiftRight(probeResult.data(), probeResult.data(), total, delay);
 
-   for(uint16_t i=0; i<data.size(); i++) {
-      buffer.insert(buffer.end(), (unsigned char)(data[i] & 0x000000FF));      
-      buffer.insert(buffer.end(), (unsigned char)((data[i] & 0x0000FF00) >> 8));      
-      buffer.insert(buffer.end(), (unsigned char)((data[i] & 0x00FF0000) >> 16));      
-      buffer.insert(buffer.end(), (unsigned char)((data[i] & 0xFF000000) >> 24));      
+   if(tdo && nbits > 0) {
+      tdo[(nbits - 1) / 8] = 0;
+      bitCopy(tdo, 0, probeResult.data(), 0, nbits);
    }
 
-   buffer.insert(buffer.end(), 0x00);
-   // end build buffer
+   printDebug("XVCDriver::probeBypassBits end", 1);
+
+   return bitMismatches(tdi, probeResult.data(), nbits);
+}
+
+// default batch: one shift per segment
+void XVCDriver::shiftv(std::vector<shift_segment> &segs) {
 
-   nbits = (32 * data.size()) + 1;
-   shift(nbits, buffer.data(), result);
-   
-   for(uint16_t i=0; i<data.size(); i++) {
-      tmpvalue = reinterpret_cast<uint64_t *>(result+(4*i));
-      rdvalue = (*tmpvalue & 0x00000001FFFFFFFF) >> 1;
-      retbuf.push_back(rdvalue);
+   for (unsigned int i = 0; i < segs.size(); i++) {
+
+      int nbytes = (segs[i].nbits + 7) / 8;
+
+      packBuffer.resize(2 * nbytes);
+      packResult.resize(nbytes + 4);
+      memcpy(packBuffer.data(), segs[i].tms, nbytes);
+      memcpy(packBuffer.data() + nbytes, segs[i].tdi, nbytes);
+
+      shift(segs[i].nbits, packBuffer.data(), packResult.data());
+
+      if (segs[i].tdo)
+         memcpy(segs[i].tdo, packResult.data(), nbytes);
    }
+}
 
-   printDebug("XVCDriver::probeBypass end", 1);
+// concatenate segments in a single shift, for backends that stream long vectors in one transaction
+void XVCDriver::shiftPacked(std::vector<shift_segment> &segs) {
 
-   return retbuf;
+   int nbits = 0, pos = 0;
+
+   for (unsigned int i = 0; i < segs.size(); i++)
+      nbits += segs[i].nbits;
+
+   int nbytes = (nbits + 7) / 8;
+
+   packBuffer.assign(2 * nbytes, 0);
+   packResult.assign(nbytes + 4, 0);
+
+   for (unsigned int i = 0; i < segs.size(); i++) {
+      bitCopy(packBuffer.data(), pos, segs[i].tms, 0, segs[i].nbits);
+      bitCopy(packBuffer.data() + nbytes, pos, segs[i].tdi, 0, segs[i].nbits);
+      pos += segs[i].nbits;
+   }
+
+   shift(nbits, packBuffer.data(), packResult.data());
+
+   pos = 0;
+   for (unsigned int i = 0; i < segs.size(); i++) {
+      if (segs[i].tdo && segs[i].nbits) {
+         segs[i].tdo[(segs[i].nbits - 1) / 8] = 0;
+         bitCopy(segs[i].tdo, 0, packResult.data(), pos, segs[i].nbits);
+      }
+      pos += segs[i].nbits;
+   }
 }
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <sstream>
+#include <thread>
 #include <unistd.h>
 
 #include "argparse.h"
@@ -11,19 +13,47 @@
 #include "axisetup.h"
 #include "ftdicalibrator.h"
 #include "ftdisetup.h"
+#include "ftdituner.h"
+#include "broadcastdevice.h"
+#include "driverbenchmark.h"
+#include "bitvector.h"
+#include "bertester.h"
+#include "calibcache.h"
+#include "backgroundcalibrator.h"
+#include "driftmonitor.h"
+#include "eyemap.h"
+#include "pointselector.h"
+#include "tempsensor.h"
+#include "thermaltables.h"
+#include "thermalmonitor.h"
 
 int main(int argc, const char **argv) {
 
    std::unique_ptr<XVCDriver> dev;
+   std::unique_ptr<XVCDriver> devB;    // second FTDI channel
    bool verbose = false;
    int debugLevel = 0;
    int port = 2542;
    bool scan = false;
    int hyst = 0;
+   const char *calibMode = "SEARCH";
    bool runCalib = false;
+   bool bgCalib = false;
+   int drift = 0;
+   const char *eyeMap = NULL;
+   const char *eyeLoad = NULL;
+   const char *eyeExport = NULL;
+   int eyeBits = 65536;
+   int eyeStep = 8;
+   const char *policyName = NULL;
+   int policyBits = POLICY_CHECK_BITS;
+   const char *thermalDir = NULL;
+   int tempBand = THERMAL_BAND;
+   int tempPeriod = 30;
    unsigned int quickCalib = 0;
    const char *saveFilename = NULL;
    const char *loadFilename = NULL;
+   const char *calibCache = NULL;
    const char *serial = NULL;
    char *busconf = NULL;
    int cdiv = -1;
@@ -40,6 +70,24 @@ int main(int argc, const char **argv) {
    int maxfreq = 30000000;    // 30 MHz
    int loop = 10;
    bool pedge = false;
+   const char *broadcast = NULL;
+   const char *backendName = "LIBFTDI";
+   int backend = BACKEND_LIBFTDI;
+   int planCacheSize = DEFAULT_PLAN_CACHE / 1024;
+   int simCheck = 0;
+   bool autotune = false;
+   const char *tuneFilename = DEFAULT_TUNE_FILE;
+   bool dual = false;
+   int cfreqb = -1;
+   bool benchmark = false;
+   bool bitbench = false;
+   int bertest = 0;
+   int prbs = 31;
+   int berbits = 0;
+   bool async = false;
+   int target = -1;
+
+   BackgroundCalibrator *bgcal = nullptr;
 
    AXISetup *asetup = new AXISetup();
    FTDISetup *fsetup = new FTDISetup();
@@ -56,17 +104,39 @@ int main(int argc, const char **argv) {
       OPT_INTEGER('d', "debug", &debugLevel, "set debug level (default: 0)"),
       OPT_STRING(0, "driver", &driverName, "set driver name [AXI,FTDI] (default: AXI)", NULL, 0, 0),
       OPT_BOOLEAN(0, "scan", &scan, "scan for connected device and exit"),
+      OPT_INTEGER(0, "target", &target, "select target device of JTAG chain, 0 nearest to TDO (default: first known device)"),
+      OPT_STRING(0, "broadcast", &broadcast, "mirror shifts on comma separated UIO ids (AXI) or serials (FTDI)", NULL, 0, 0),
+      OPT_BOOLEAN(0, "benchmark", &benchmark, "measure bypass shift throughput of opened chains and exit"),
+      OPT_BOOLEAN(0, "bitbench", &bitbench, "measure bit-vector kernels and exit"),
+      OPT_INTEGER(0, "bertest", &bertest, "stream given number of PRBS bits through BYPASS, print bit error rate and exit"),
+      OPT_INTEGER(0, "prbs", &prbs, "set PRBS pattern of bit error tests [7,15,31] (default: 31)"),
       OPT_GROUP("Network options"),
       OPT_INTEGER('p', "port", &port, "set server port (default: 2542)"),
+      OPT_BOOLEAN(0, "async", &async, "queue shift commands to the driver while previous ones run"),
       OPT_GROUP("Calibration options"),
       OPT_BOOLEAN('r', "runcalib", &runCalib, "start calibration and run server (default: max freq)"),
+      OPT_BOOLEAN(0, "bgcalib", &bgCalib, "start server at a safe clock and calibrate in background"),
       OPT_INTEGER('q', "quick", &quickCalib, "enable quick mode with max probe values"),
       OPT_STRING('s', "savecalib", &saveFilename, "start calibration and save data to file", NULL, 0, 0),
       OPT_STRING('l', "loadcalib", &loadFilename, "load calibration data from file", NULL, 0, 0),
+      OPT_STRING(0, "calibcache", &calibCache, "set calibration cache directory, runcalib reuses a validated entry", NULL, 0, 0),
       OPT_INTEGER(0, "id", &id, "load calibration entry from file by id"),
       OPT_INTEGER(0, "freq", &freq, "load calibration entry from file by clock frequency"),
+      OPT_STRING(0, "calibmode", &calibMode, "set calibration mode [SWEEP,SEARCH], AXI also PREDICT, FTDI also CHECK (default: SEARCH)", NULL, 0, 0),
+      OPT_INTEGER(0, "berbits", &berbits, "set PRBS bits checked on each calibration point (default: 0 - disabled)"),
+      OPT_STRING(0, "policy", &policyName, "set operating point policy [MAXFREQ,MARGIN:<pct>,THROUGHPUT[:<pct>]] (default: MAXFREQ)", NULL, 0, 0),
+      OPT_INTEGER(0, "policybits", &policyBits, "set PRBS bits measured on each point by THROUGHPUT policy (default: 1000000)"),
       OPT_GROUP("AXI Calibration options"),
       OPT_INTEGER(0, "hyst", &hyst, "set hysteresis value (default: 0)"),
+      OPT_INTEGER(0, "drift", &drift, "check capture delay window every given seconds while serving (default: 0 - disabled)"),
+      OPT_STRING(0, "eyemap", &eyeMap, "capture PRBS error map of delays and divisors, save it to file and exit", NULL, 0, 0),
+      OPT_STRING(0, "eyeload", &eyeLoad, "load eye map file instead of capturing it and exit", NULL, 0, 0),
+      OPT_STRING(0, "eyeexport", &eyeExport, "export eye map to CSV or JSON (.json) file", NULL, 0, 0),
+      OPT_INTEGER(0, "eyebits", &eyeBits, "set PRBS bits of each eye map cell (default: 65536)"),
+      OPT_INTEGER(0, "eyestep", &eyeStep, "set clock divisor step of eye map rows (default: 8)"),
+      OPT_STRING(0, "thermal", &thermalDir, "keep calibration tables by die temperature band in directory, switch them while serving", NULL, 0, 0),
+      OPT_INTEGER(0, "tempband", &tempBand, "set temperature band width of thermal tables in Celsius (default: 10)"),
+      OPT_INTEGER(0, "tempperiod", &tempPeriod, "sample die temperature every given seconds between client sessions (default: 30)"),
       OPT_GROUP("AXI Quick Setup options"),
       OPT_INTEGER(0, "cdiv", &cdiv, "set clock divisor (0:1023)", NULL, 0, 0),
       OPT_INTEGER(0, "cdel", &cdel, "set capture delay (0:255)", NULL, 0, 0),
@@ -76,6 +146,12 @@ int main(int argc, const char **argv) {
       OPT_INTEGER(0, "interface", &interface, "set FTDI device JTAG interface (default: 1)", NULL, 0, 0), 
       OPT_STRING(0, "serial", &serial, "set serial number (default: none)", NULL, 0, 0),
       OPT_STRING(0, "busconfig", &busconf, "set bus config (default: 0x00:0x0B:0x00:0x00)", NULL, 0, 0),
+      OPT_STRING(0, "backend", &backendName, "set FTDI USB backend [LIBFTDI,LIBUSB,SIM] (default: LIBFTDI)", NULL, 0, 0),
+      OPT_INTEGER(0, "plancache", &planCacheSize, "set FTDI shift plan cache size in kB (default: 1024, 0: disabled)", NULL, 0, 0),
+      OPT_BOOLEAN(0, "autotune", &autotune, "tune FTDI USB transfers and save result to tuning file"),
+      OPT_STRING(0, "tunefile", &tuneFilename, "set FTDI tuning file (default: ftditune.txt)", NULL, 0, 0),
+      OPT_BOOLEAN(0, "dual", &dual, "open FTDI channels A and B, second channel served on port+1"),
+      OPT_INTEGER(0, "simcheck", &simCheck, "compare given number of random shifts with a scalar reference of the SIM chain and exit"),
       OPT_GROUP("FTDI Calibration options"),
       OPT_INTEGER(0, "minfreq", &minfreq, "set min clock frequency for calibration (default: 100000 - 100 kHz)", NULL, 0, 0),
       OPT_INTEGER(0, "maxfreq", &maxfreq, "set max clock frequency for calibration (default: 30000000 - 30 MHz)", NULL, 0, 0),
@@ -83,6 +159,7 @@ int main(int argc, const char **argv) {
       OPT_GROUP("FTDI Quick Setup options"),
       OPT_INTEGER(0, "cfreq", &cfreq, "set FTDI clock frequency", NULL, 0, 0),
       OPT_BOOLEAN(0, "pedge", &pedge, "set FTDI TDO positive sampling edge (default: 0 - negative)"),
+      OPT_INTEGER(0, "cfreqb", &cfreqb, "set FTDI clock frequency of second channel (default: own calibration with runcalib, same as first otherwise)", NULL, 0, 0),
       OPT_END(),
    };
 
@@ -91,8 +168,60 @@ int main(int argc, const char **argv) {
    argparse_describe(&argparse, "\nXilinx Virtual Cable (XVC) adaptive server", "\nDefine AXIJTAG_UIO_ID environment variable to specify UIO device file id (default: 1 => /dev/uio1)\n\n");
    argparse_parse(&argparse, argc, argv);
 
+   if(bitbench) {
+      bitBenchmark();
+      exit(0);
+   }
+
+   if(prbs != 7 && prbs != 15 && prbs != 31) {
+      std::cout << "E: PRBS pattern not supported: " << prbs << std::endl;
+      exit(-1);
+   }
+
+   PointSelector selector(verbose, debugLevel);
+   selector.setPattern(prbs);
+   selector.setCheckBits(std::max(policyBits, 1));
+   if(policyName && !selector.setPolicy(policyName)) {
+      std::cout << "E: operating point policy not supported: " << policyName << std::endl;
+      exit(-1);
+   }
+
+   if((eyeMap || eyeLoad) && (eyeBits <= 0 || eyeStep <= 0)) {
+      std::cout << "E: eye map bits and divisor step must be positive numbers" << std::endl;
+      exit(-1);
+   }
+
+   if(eyeLoad) {
+      EyeMap map;
+      if(!map.loadFile(eyeLoad)) {
+         std::cout << "E: file " << eyeLoad << " loading error" << std::endl;
+         exit(-1);
+      }
+      std::cout << "I: eye map " << eyeLoad << " loaded: " << map.getRows() << " rows" << std::endl;
+      if(eyeExport) {
+         if(map.exportFile(eyeExport))
+            std::cout << "I: eye map exported to " << eyeExport << std::endl;
+         else std::cout << "E: file " << eyeExport << " saving error" << std::endl;
+      }
+      map.toSetup(asetup);
+      asetup->print();
+      if(saveFilename && asetup->saveFile(saveFilename))
+         std::cout << "I: calibration data saved in " << saveFilename << std::endl;
+      exit(0);
+   }
+
    std::cout << "I: using driver " << driverName << std::endl;
 
+   if(dual && (std::string(driverName) != "FTDI")) {
+      std::cout << "E: dual channel mode not supported by driver " << driverName << std::endl;
+      exit(-1);
+   }
+
+   if(dual && broadcast) {
+      std::cout << "E: dual channel mode and broadcast mode can't be used together" << std::endl;
+      exit(-1);
+   }
+
    if(std::string(driverName) == "AXI") {
       try {
          dev.reset(new AXIDevice(verbose, debugLevel));
@@ -101,8 +230,30 @@ int main(int argc, const char **argv) {
          exit(-1);
       }
    } else if(std::string(driverName) == "FTDI") {
+      if(std::string(backendName) == "LIBUSB")
+         backend = BACKEND_LIBUSB;
+      else if(std::string(backendName) == "SIM")
+         backend = BACKEND_SIM;
+      else if(std::string(backendName) != "LIBFTDI") {
+         std::cout << "E: FTDI backend " << backendName << " not found" << std::endl;
+         exit(-1);
+      }
       try {
-         dev.reset(new FTDIDevice(vid, pid, interface, serial, busconf, verbose, debugLevel));
+         FTDIDevice *fdev = new FTDIDevice(vid, pid, interface, serial, busconf, verbose, debugLevel, backend);
+         fdev->setPlanCacheSize((size_t) std::max(planCacheSize, 0) * 1024);
+         dev.reset(fdev);
+
+         if(dual) {
+            // MPSSE is available on channels A and B
+            if(interface != INTERFACE_A && interface != INTERFACE_B) {
+               std::cout << "E: dual channel mode requires interface A (1) or B (2)" << std::endl;
+               exit(-1);
+            }
+            enum ftdi_interface ifb = (interface == INTERFACE_A) ? INTERFACE_B : INTERFACE_A;
+            FTDIDevice *fdevb = new FTDIDevice(vid, pid, ifb, serial, busconf, verbose, debugLevel, backend);
+            fdevb->setPlanCacheSize((size_t) std::max(planCacheSize, 0) * 1024);
+            devB.reset(fdevb);
+         }
       } catch (const std::exception& e) {
          std::cout << e.what() << std::endl;
          exit(-1);
@@ -112,27 +263,174 @@ int main(int argc, const char **argv) {
       exit(-1);
    }
 
+   std::vector<chain_device> chain = dev.get()->getChain();
+   if(chain.size() > 1) {
+      std::cout << "I: JTAG chain of " << chain.size() << " devices (0 nearest to TDO)" << std::endl;
+      for(unsigned int i=0; i<chain.size(); i++)
+         std::cout << "I:    " << i << ": " << chain[i].desc <<
+            " idcode: 0x" << std::hex << chain[i].idcode << std::dec <<
+            " irlen: " << chain[i].irlen << std::endl;
+   }
+
+   if(target >= 0) {
+      if(!dev.get()->selectDevice(target)) {
+         std::cout << "E: target device " << target << " not found in JTAG chain" << std::endl;
+         exit(-1);
+      }
+      std::cout << "I: target device " << target << " selected" << std::endl;
+   }
+
    if(dev.get()->isDetected())
       std::cout << "I: device detected: " << dev.get()->getDescription() << 
          " idcode: 0x" << std::hex << dev.get()->getIdCode() << std::dec <<
          " irlen: " << dev.get()->getIrLen() <<
          " idcmd: 0x" << std::hex << dev.get()->getIdCmd() << std::dec << std::endl;
 
+   if(devB && devB.get()->isDetected())
+      std::cout << "I: device detected on second channel: " << devB.get()->getDescription() << 
+         " idcode: 0x" << std::hex << devB.get()->getIdCode() << std::dec <<
+         " irlen: " << devB.get()->getIrLen() <<
+         " idcmd: 0x" << std::hex << devB.get()->getIdCmd() << std::dec << std::endl;
+
    if(scan)
       exit(0);
 
-   if(runCalib || saveFilename) {
+   if(simCheck > 0) {
+      if(dev.get()->getName() != "FTDI") {
+         std::cout << "E: encoder check not supported by driver " << driverName << std::endl;
+         exit(-1);
+      }
+      exit(((FTDIDevice *) dev.get())->checkEncoder(simCheck) ? 0 : -1);
+   }
+
+   if(bgCalib && (saveFilename || loadFilename || broadcast || benchmark || bertest > 0)) {
+      std::cout << "E: background calibration can't be used with savecalib, loadcalib, broadcast, benchmark or bertest" << std::endl;
+      exit(-1);
+   }
+
+   if(thermalDir) {
+      if(dev.get()->getName() != "AXI") {
+         std::cout << "E: thermal tables not supported by driver " << driverName << std::endl;
+         exit(-1);
+      }
+      if(!runCalib || bgCalib || loadFilename || calibCache || broadcast || drift > 0 || id != -1) {
+         std::cout << "E: thermal tables require runcalib and can't be used with bgcalib, loadcalib, calibcache, broadcast, drift or id" << std::endl;
+         exit(-1);
+      }
+      if(tempBand <= 0 || tempPeriod <= 0) {
+         std::cout << "E: temperature band width and sampling period must be positive numbers" << std::endl;
+         exit(-1);
+      }
+   }
+
+   if(eyeMap) {
+      if(dev.get()->getName() != "AXI") {
+         std::cout << "E: eye map not supported by driver " << driverName << std::endl;
+         exit(-1);
+      }
+      EyeMap map;
+      AXICalibrator *calib = new AXICalibrator((AXIDevice *) dev.get());
+      calib->setDebugLevel(debugLevel);
+      calib->setVerbose(verbose);
+      calib->setBERTest(0, prbs);
+      calib->captureEyeMap(&map, eyeStep, eyeBits);
+      if(map.saveFile(eyeMap))
+         std::cout << "I: eye map saved in " << eyeMap << std::endl;
+      else std::cout << "E: file " << eyeMap << " saving error" << std::endl;
+      if(eyeExport) {
+         if(map.exportFile(eyeExport))
+            std::cout << "I: eye map exported to " << eyeExport << std::endl;
+         else std::cout << "E: file " << eyeExport << " saving error" << std::endl;
+      }
+      // operating points at the widest error free margin of each divisor
+      map.toSetup(asetup);
+      asetup->print();
+      if(saveFilename && asetup->saveFile(saveFilename))
+         std::cout << "I: calibration data saved in " << saveFilename << std::endl;
+      exit(0);
+   }
+
+   CalibCache *cache = nullptr;
+   if(calibCache) {
+      cache = new CalibCache(calibCache, verbose);
+      if(dev.get()->getName() == "AXI")
+         cache->setKey(dev.get(), ((AXIDevice *) dev.get())->getUioDevice());
+      else
+         cache->setKey(dev.get(), ((FTDIDevice *) dev.get())->getSerial() + "-" + std::to_string(interface));
+   }
+
+   // die temperature is recorded with calibration data of thermal tables
+   TempSensor *sensor = nullptr;
+   ThermalTables *tables = nullptr;
+   AXICalibrator *thermalCalib = nullptr;
+   int thermalBand = 0;
+   if(thermalDir) {
+      double celsius;
+      sensor = new TempSensor(dev.get(), verbose, debugLevel);
+      if(!sensor->read(celsius)) {
+         std::cout << "E: die temperature of target device can't be read" << std::endl;
+         exit(-1);
+      }
+      tables = new ThermalTables(thermalDir, tempBand, verbose);
+      tables->setKey(dev.get());
+      thermalBand = tables->getBand(celsius);
+      printf("I: die temperature %.1f C, thermal band %d C\n", celsius, tables->getBandFloor(thermalBand));
+   }
+
+   if(runCalib || saveFilename || bgCalib) {
       if(dev.get()->getName() == "AXI") {
          asetup->setVerbose(verbose);
          std::cout << "I: start calibration task" << std::endl;
          AXICalibrator *calib = new AXICalibrator((AXIDevice *) dev.get());
          calib->setDebugLevel(debugLevel);
          calib->setVerbose(verbose);
+         calib->setBERTest(berbits, prbs);
+         if(sensor)
+            calib->setSensor(sensor);
+         if(std::string(calibMode) == "SWEEP")
+            calib->setMode(CALIB_SWEEP);
+         else if(std::string(calibMode) == "SEARCH")
+            calib->setMode(CALIB_SEARCH);
+         else if(std::string(calibMode) == "PREDICT")
+            calib->setMode(CALIB_PREDICT);
+         else {
+            std::cout << "E: calibration mode not supported by AXI driver: " << calibMode << std::endl;
+            exit(-1);
+         }
          if(hyst) {
             calib->setHysteresis(hyst);
             std::cout << "I: apply hysteresis value " << hyst << std::endl;
          }
-         calib->start(asetup, quickCalib);
+         if(bgCalib) {
+            // a validated cache entry is used at once, otherwise clients start at the safe clock
+            if(!(cache && cache->restore((AXIDevice *) dev.get(), calib, asetup, freq))) {
+               if(!calib->setSafeClock()) {
+                  std::cout << "E: no valid capture delay at slowest clock" << std::endl;
+                  exit(-1);
+               }
+               std::cout << "I: serving at safe clock, calibration runs in background" << std::endl;
+               bgcal = new BackgroundCalibrator(dev.get(), verbose, debugLevel);
+               bgcal->setFrequency(freq);
+               bgcal->setCache(cache);
+               bgcal->setTask(calib, asetup, quickCalib);
+            }
+            goto startServer;
+         }
+         if(tables) {
+            // table of the current temperature band replaces calibration, bands are calibrated while serving
+            thermalCalib = calib;
+            if(!tables->restore((AXIDevice *) dev.get(), asetup, thermalBand, freq)) {
+               calib->start(asetup, quickCalib);
+               if(tables->save(asetup, thermalBand))
+                  std::cout << "I: calibration data saved in " << tables->getFilename(thermalBand) << std::endl;
+            }
+         }
+         // a validated cache entry replaces calibration, unless a new file is requested
+         else if(!(cache && runCalib && !saveFilename && cache->restore((AXIDevice *) dev.get(), calib, asetup, freq))) {
+            calib->start(asetup, quickCalib);
+            if(cache && cache->save(asetup))
+               std::cout << "I: calibration data saved in cache " << cache->getFilename() << std::endl;
+         }
          if(saveFilename) {
             // save calibration data to file
             asetup->saveFile(saveFilename);
@@ -148,6 +446,21 @@ int main(int argc, const char **argv) {
          FTDICalibrator *calib = new FTDICalibrator((FTDIDevice *) dev.get());
          calib->setDebugLevel(debugLevel);
          calib->setVerbose(verbose);
+         calib->setBERTest(berbits, prbs);
+         if(std::string(calibMode) == "SWEEP")
+            calib->setMode(FCALIB_SWEEP);
+         else if(std::string(calibMode) == "SEARCH")
+            calib->setMode(FCALIB_SEARCH);
+         else if(std::string(calibMode) == "CHECK")
+            calib->setMode(FCALIB_CHECK);
+         else {
+            std::cout << "E: calibration mode not supported by FTDI driver: " << calibMode << std::endl;
+            exit(-1);
+         }
+         if(minfreq <= 0) {
+            std::cout << "E: calibration min clock frequency must be positive number" << std::endl;
+            exit(-1);
+         }
          if(minfreq > maxfreq) {
             std::cout << "E: calibration min clock frequency is greater then max clock frequency" << std::endl;
             exit(-1);
@@ -156,7 +469,26 @@ int main(int argc, const char **argv) {
             std::cout << "E: calibration loop must be positive number" << std::endl;
             exit(-1);
          }
-         calib->start(fsetup, minfreq, maxfreq, loop);
+         if(bgCalib) {
+            // a validated cache entry is used at once, otherwise clients start at the safe clock
+            if(!(cache && cache->restore((FTDIDevice *) dev.get(), fsetup, freq))) {
+               FTDIDevice *fdev = (FTDIDevice *) dev.get();
+               fdev->setClockFrequency(minfreq);
+               fdev->setTDOPosSampling(false);
+               std::cout << "I: serving at safe clock " << minfreq << " Hz, calibration runs in background" << std::endl;
+               bgcal = new BackgroundCalibrator(dev.get(), verbose, debugLevel);
+               bgcal->setFrequency(freq);
+               bgcal->setCache(cache);
+               bgcal->setTask(calib, fsetup, minfreq, maxfreq, loop);
+            }
+            goto startServer;
+         }
+         // a validated cache entry replaces calibration, unless a new file is requested
+         if(!(cache && runCalib && !saveFilename && cache->restore((FTDIDevice *) dev.get(), fsetup, freq))) {
+            calib->start(fsetup, minfreq, maxfreq, loop);
+            if(cache && cache->save(fsetup))
+               std::cout << "I: calibration data saved in cache " << cache->getFilename() << std::endl;
+         }
          if(saveFilename) {
             // save calibration data to file
             fsetup->saveFile(saveFilename);
@@ -241,11 +573,14 @@ int main(int argc, const char **argv) {
             goto startServer;
          }
          
+         AXIDevice *adev = (AXIDevice *) dev.get();
+
          // check for freq command line options
          if(freq != -1)
             item = asetup->getItemByFrequency(freq);
+         else if(policyName && (item = selector.select(adev, asetup)) == nullptr)
+            exit(-1);
 
-         AXIDevice *adev = (AXIDevice *) dev.get();
          adev->setClockDelay(item->getClockDelay());
          adev->setClockDiv(item->getClockDivisor());
          std::cout << "I: AXI setup with id " << item->getId() << " successfully" << std::endl;
@@ -274,7 +609,7 @@ int main(int argc, const char **argv) {
             item = fsetup->getItemById(id);
             if(item != nullptr) {
                FTDIDevice *fdev = (FTDIDevice *) dev.get();
-               fdev->setClockDiv(DIV5_OFF, item->getClockDivisor());
+               fdev->setClockDiv(item->getClockDiv5(), item->getClockDivisor());
                fdev->setTDOPosSampling((bool)item->getTDOSampling());
                std::cout << "I: FTDI setup with id " << id << " successfully" << std::endl;
                item->print();
@@ -282,12 +617,15 @@ int main(int argc, const char **argv) {
             goto startServer;
          }
          
+         FTDIDevice *fdev = (FTDIDevice *) dev.get();
+
          // check for freq command line options
          if(freq != -1)
             item = fsetup->getItemByFrequency(freq);
+         else if(policyName && (item = selector.select(fdev, fsetup)) == nullptr)
+            exit(-1);
 
-         FTDIDevice *fdev = (FTDIDevice *) dev.get();
-         fdev->setClockDiv(DIV5_OFF, item->getClockDivisor());
+         fdev->setClockDiv(item->getClockDiv5(), item->getClockDivisor());
          fdev->setTDOPosSampling((bool)item->getTDOSampling());
          std::cout << "I: FTDI setup with id " << item->getId() << " successfully" << std::endl;
          item->print();
@@ -296,8 +634,170 @@ int main(int argc, const char **argv) {
 
 startServer:
 
-   IOServer *srv = new IOServer(dev.get());
+   if(dev.get()->getName() == "FTDI") {
+      FTDITuner tuner((FTDIDevice *) dev.get());
+      tuner.setVerbose(verbose);
+      if(autotune) {
+         if(tuner.run()) {
+            if(tuner.saveFile(tuneFilename))
+               std::cout << "I: FTDI tuning saved in " << tuneFilename << std::endl;
+            else std::cout << "E: file " << tuneFilename << " saving error" << std::endl;
+         }
+      } else tuner.loadFile(tuneFilename);
+   }
+
+   if(devB) {
+      // second channel has its own clock: calibrated on its chain with runcalib,
+      // first channel setup otherwise
+      FTDIDevice *fdev = (FTDIDevice *) dev.get();
+      FTDIDevice *fdevb = (FTDIDevice *) devB.get();
+      FTDITuner(fdevb).loadFile(tuneFilename);
+      if(cfreqb != -1) {
+         std::cout << "I: apply clock frequency " << cfreqb << " on second channel" << std::endl;
+         fdevb->setClockFrequency(cfreqb);
+         fdevb->setTDOPosSampling(fdev->getTDOPosSampling());
+      } else if(runCalib && !loadFilename && !quickSetup) {
+         FTDISetup *fsetupb = new FTDISetup();
+         fsetupb->setVerbose(verbose);
+         CalibCache *cacheb = nullptr;
+         if(calibCache) {
+            cacheb = new CalibCache(calibCache, verbose);
+            cacheb->setKey(fdevb, fdevb->getSerial() + "-" + std::to_string(interface == INTERFACE_A ? INTERFACE_B : INTERFACE_A));
+         }
+         if(!(cacheb && cacheb->restore(fdevb, fsetupb, freq))) {
+            std::cout << "I: start calibration task on second channel" << std::endl;
+            FTDICalibrator *calibb = new FTDICalibrator(fdevb);
+            calibb->setDebugLevel(debugLevel);
+            calibb->setVerbose(verbose);
+            calibb->setBERTest(berbits, prbs);
+            calibb->setMode((std::string(calibMode) == "SWEEP") ? FCALIB_SWEEP :
+               (std::string(calibMode) == "CHECK") ? FCALIB_CHECK : FCALIB_SEARCH);
+            calibb->start(fsetupb, minfreq, maxfreq, loop);
+            if(cacheb && cacheb->save(fsetupb))
+               std::cout << "I: calibration data of second channel saved in cache " << cacheb->getFilename() << std::endl;
+         }
+         FTDICalibItem *item = (freq != -1) ? fsetupb->getItemByFrequency(freq) : fsetupb->getItemByMaxFrequency();
+         if(item && policyName && freq == -1)
+            item = selector.select(fdevb, fsetupb);
+         if(item == nullptr) {
+            std::cout << "E: no valid calibration setting found on second channel" << std::endl;
+            exit(-1);
+         }
+         fdevb->setClockDiv(item->getClockDiv5(), item->getClockDivisor());
+         fdevb->setTDOPosSampling((bool)item->getTDOSampling());
+         std::cout << "I: FTDI setup of second channel with id " << item->getId() << " successfully" << std::endl;
+         item->print();
+      } else {
+         fdevb->setClockDiv(fdev->getClockDiv5(), fdev->getClockDiv());
+         fdevb->setTDOPosSampling(fdev->getTDOPosSampling());
+      }
+   }
+
+   XVCDriver *srvdev = dev.get();
+
+   if(broadcast) {
+
+      BroadcastDevice *bdev = new BroadcastDevice(dev.get(), verbose, debugLevel);
+      std::stringstream ss(broadcast);
+      std::string chain;
+
+      while(std::getline(ss, chain, ',')) {
+         try {
+            if(dev.get()->getName() == "AXI") {
+               AXIDevice *pdev = (AXIDevice *) dev.get();
+               AXIDevice *adev = new AXIDevice(verbose, debugLevel, chain.c_str());
+               adev->setClockDiv(pdev->getClockDiv());
+               adev->setClockDelay(pdev->getClockDelay());
+               bdev->addChain(adev);
+            } else if(dev.get()->getName() == "FTDI") {
+               FTDIDevice *pdev = (FTDIDevice *) dev.get();
+               FTDIDevice *fdev = new FTDIDevice(vid, pid, interface, chain.c_str(), busconf, verbose, debugLevel, backend);
+               fdev->setPlanCacheSize((size_t) std::max(planCacheSize, 0) * 1024);
+               fdev->setClockDiv(pdev->getClockDiv5(), pdev->getClockDiv());
+               fdev->setTDOPosSampling(pdev->getTDOPosSampling());
+               FTDITuner(fdev).loadFile(tuneFilename);
+               bdev->addChain(fdev);
+            }
+         } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+            exit(-1);
+         }
+         std::cout << "I: broadcast chain " << bdev->getChainCount() - 1 << " added (" << chain << ")" << std::endl;
+      }
+
+      std::cout << "I: broadcast mode on " << bdev->getChainCount() << " chains" << std::endl;
+      srvdev = bdev;
+   }
+
+   if(benchmark) {
+      DriverBenchmark bench(verbose);
+      bench.addDriver(srvdev, "port " + std::to_string(port));
+      if(devB)
+         bench.addDriver(devB.get(), "port " + std::to_string(port + 1));
+      bench.run();
+      exit(0);
+   }
+
+   if(bertest > 0) {
+      BERTester ber(dev.get(), verbose, debugLevel);
+      ber.setPattern(prbs);
+      ber.printResult(ber.run(bertest));
+      if(devB) {
+         BERTester berB(devB.get(), verbose, debugLevel);
+         berB.setPattern(prbs);
+         std::cout << "I: second channel" << std::endl;
+         berB.printResult(berB.run(bertest));
+      }
+      exit(0);
+   }
+
+   // driver setup is complete, calibration shares it with clients from now on
+   if(bgcal)
+      bgcal->start();
+
+   if(drift > 0) {
+      if(dev.get()->getName() == "AXI" && !broadcast) {
+         AXICalibrator *mcalib = new AXICalibrator((AXIDevice *) dev.get());
+         mcalib->setDebugLevel(debugLevel);
+         mcalib->setHysteresis(hyst);
+         DriftMonitor *monitor = new DriftMonitor((AXIDevice *) dev.get(), mcalib, asetup, verbose, debugLevel);
+         monitor->setPeriod(drift);
+         monitor->start(bgcal);
+      } else std::cout << "E: drift monitor not supported by driver " << driverName << (broadcast ? " in broadcast mode" : "") << std::endl;
+   }
+
+   ThermalMonitor *tmonitor = nullptr;
+   if(tables) {
+      tmonitor = new ThermalMonitor((AXIDevice *) dev.get(), thermalCalib, sensor, tables, verbose, debugLevel);
+      tmonitor->setPeriod(tempPeriod);
+      tmonitor->setFrequency(freq);
+      tmonitor->setCalibSize(quickCalib);
+      tmonitor->start(thermalBand);
+   }
+
+   std::thread channelB;
+   if(devB) {
+      // second channel is served by its own thread
+      channelB = std::thread([&devB, port, verbose, async]() {
+         IOServer *srvb = new IOServer(devB.get());
+         srvb->setVerbose(verbose);
+         srvb->setAsync(async);
+         std::cout << "I: using TCP port " << port + 1 << " for second channel" << std::endl;
+         srvb->setPort(port + 1);
+         try {
+            srvb->start();
+         } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+         }
+      });
+   }
+
+   IOServer *srv = new IOServer(srvdev);
    srv->setVerbose(verbose);
+   srv->setAsync(async);
+   // die temperature is sampled between client sessions
+   if(tmonitor)
+      srv->setSessionHook([tmonitor](bool open) { tmonitor->session(open); });
 
    std::cout << "I: using TCP port " << port << std::endl;
    srv->setPort(port);
@@ -309,5 +809,8 @@ startServer:
       std::cout << e.what() << std::endl;
    }
 
+   if(channelB.joinable())
+      channelB.join();
+
    return 0;
 }